@@ -21,30 +21,32 @@ void Portal::Draw(Shader *shader, Shader *borderShader, mat4 view, mat4 proj) {
     DrawBorder(borderShader, view, proj);
 }
 
-void Portal::DrawPerpendicular(Shader *shader, Shader *borderShader, mat4 view, mat4 proj) {
+void Portal::DrawPerpendicular(Shader *shader, Shader *borderShader, mat4 view, mat4 proj, float cameraYaw) {
     shader->use();
 
     mat4 cheatLocal = mat4(1.0f);
     cheatLocal = translate(cheatLocal, position);
-    cheatLocal = glm::rotate(cheatLocal, -glm::radians(c->Yaw), glm::vec3(0.f, 1., 0.0f));
+    cheatLocal = glm::rotate(cheatLocal, -glm::radians(cameraYaw), glm::vec3(0.f, 1., 0.0f));
     cheatLocal = glm::rotate(cheatLocal, glm::radians(90.f), vec3(0, 1.f, 0));
 
-    shader->setMat4("projection", proj);
-    shader->setMat4("model", cheatLocal);
-    shader->setMat4("view", view);
+    shader->setMat4(Shader::PROJECTION, proj);
+    shader->setMat4(Shader::MODEL, cheatLocal);
+    shader->setMat4(Shader::VIEW, view);
+    // tints the surface when drawn with a DEBUG_COLOUR variant, ignored otherwise
+    shader->setVec3(Shader::COLOR, idx == 1 ? vec3(0, 0, 1.f) : vec3(1, 0, 0));
 
     glBindVertexArray(this->VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 
     borderShader->use();
-    borderShader->setMat4("projection", proj);
-    borderShader->setMat4("model", cheatLocal);
-    borderShader->setMat4("view", view);
+    borderShader->setMat4(Shader::PROJECTION, proj);
+    borderShader->setMat4(Shader::MODEL, cheatLocal);
+    borderShader->setMat4(Shader::VIEW, view);
     if (idx == 1) {
-        borderShader->setVec3("color", vec3(0, 0, 1.f));
+        borderShader->setVec3(Shader::COLOR, vec3(0, 0, 1.f));
     } else {
-        borderShader->setVec3("color", vec3(1, 0, 0));
+        borderShader->setVec3(Shader::COLOR, vec3(1, 0, 0));
     }
     glBindVertexArray(VAOBorder);
     glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, 0);
@@ -54,9 +56,9 @@ void Portal::DrawPerpendicular(Shader *shader, Shader *borderShader, mat4 view,
 void Portal::DrawWithoutBorder(Shader *shader, mat4 view, mat4 proj) {
     shader->use();
 
-    shader->setMat4("projection", proj);
-    shader->setMat4("model", localToWorld);
-    shader->setMat4("view", view);
+    shader->setMat4(Shader::PROJECTION, proj);
+    shader->setMat4(Shader::MODEL, localToWorld);
+    shader->setMat4(Shader::VIEW, view);
 
     glBindVertexArray(this->VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
@@ -65,13 +67,13 @@ void Portal::DrawWithoutBorder(Shader *shader, mat4 view, mat4 proj) {
 
 void Portal::DrawBorder(Shader *borderShader, mat4 view, mat4 proj) {
     borderShader->use();
-    borderShader->setMat4("projection", proj);
-    borderShader->setMat4("model", localToWorld);
-    borderShader->setMat4("view", view);
+    borderShader->setMat4(Shader::PROJECTION, proj);
+    borderShader->setMat4(Shader::MODEL, localToWorld);
+    borderShader->setMat4(Shader::VIEW, view);
     if (idx == 1) {
-        borderShader->setVec3("color", vec3(0, 0, 1.f));
+        borderShader->setVec3(Shader::COLOR, vec3(0, 0, 1.f));
     } else {
-        borderShader->setVec3("color", vec3(1, 0, 0));
+        borderShader->setVec3(Shader::COLOR, vec3(1, 0, 0));
     }
     glBindVertexArray(VAOBorder);
     glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, 0);
@@ -96,28 +98,23 @@ mat4 Portal::calculateViewNoRotation(mat4 view) {
     return finalView;
 }
 
-Portal::Portal(vec3 position, vec3 normal, Portal *otherPortal, GLuint fbo, GLuint tex, int idx, Camera *c) : Portal(position,
+Portal::Portal(vec3 position, vec3 normal, Portal *otherPortal, GLuint fbo, GLuint tex, int idx, float yaw) : Portal(position,
                                                                                                           normal,
                                                                                                           otherPortal,
-                                                                                                          c) {
+                                                                                                          yaw) {
     this->idx = idx;
     texture = tex;
     framebuffer = fbo;
 }
 
-Portal::Portal(vec3 position, vec3 normal, Portal *otherPortal, Camera *c) : otherPortal(otherPortal), position(position),
-                                                                  normal(normal), c(c) {
+Portal::Portal(vec3 position, vec3 normal, Portal *otherPortal, float yaw) : otherPortal(otherPortal), position(position),
+                                                                  normal(normal) {
     if (otherPortal != nullptr) {
-        /**
-         * Check if the other portal is pointing to another portal than us
-         */
-        if (otherPortal->otherPortal != nullptr) {
-            delete otherPortal->otherPortal;
-        }
+        // whoever created the portal we replace at the other end releases it
         otherPortal->otherPortal = this;
     }
     localToWorld = translate(mat4(1.0f), position);
-    localToWorld = glm::rotate(localToWorld, -glm::radians(c->Yaw), glm::vec3(0.f, 1., 0.0f));
+    localToWorld = glm::rotate(localToWorld, -glm::radians(yaw), glm::vec3(0.f, 1., 0.0f));
     localToWorld = glm::rotate(localToWorld, glm::radians(90.f), vec3(0, 1.f, 0));
     float portalVertices[] = {
             -1.f, 1.f, 0.0f, 0, 1.f,
@@ -191,6 +188,28 @@ void Portal::parsePositionAttribute() const {// position attribute
     glEnableVertexAttribArray(0);
 }
 
+/**
+ * World space plane through the other portal, for use with gl_ClipDistance when rendering calculateView().
+ * Keeps what lies behind the other portal as seen from the virtual camera, the viewer may stand on either side.
+ */
+vec4 Portal::clipPlane(vec3 viewerPosition) {
+    vec4 viewerLocal = inverse(localToWorld) * vec4(viewerPosition, 1.0f);
+    float side = viewerLocal.z < 0.0f ? -1.0f : 1.0f;
+    vec3 otherNormal = side * normalize(vec3(otherPortal->localToWorld[2]));
+    return vec4(otherNormal, -dot(otherNormal, otherPortal->position));
+}
+
+/**
+ * World space corners of the portal surface, in winding order. Views rendered through the other portal can only see
+ * what lies inside the pyramid from the virtual camera through these.
+ */
+void Portal::corners(vec3 out[4]) const {
+    const vec2 local[4] = {vec2(-1.f, 1.f), vec2(-1.f, -1.f), vec2(1.f, -1.f), vec2(1.f, 1.f)};
+    for (int i = 0; i < 4; i++) {
+        out[i] = vec3(localToWorld * vec4(local[i].x, local[i].y, 0.0f, 1.0f));
+    }
+}
+
 mat4 Portal::clippedProjMat(mat4 view, mat4 proj) {
     /**
      * Based on https://github.com/ThomasRinsma/opengl-game-test/blob/8363bbfcce30acc458b8faacc54c199279092f81/src/sceneobject/portal.cc
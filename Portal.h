@@ -12,24 +12,27 @@ using namespace glm;
 
 class Portal {
 public:
-    Portal(vec3 position, vec3 normal, Portal *otherPortal, Camera *c = nullptr);
+    // yaw is the placing camera's, in degrees; the portal faces back along it
+    Portal(vec3 position, vec3 normal, Portal *otherPortal, float yaw = 0.0f);
 
-    Portal(vec3 position, vec3 normal, Portal *otherPortal, GLuint fbo, GLuint tex, int idx, Camera *c);
+    Portal(vec3 position, vec3 normal, Portal *otherPortal, GLuint fbo, GLuint tex, int idx, float yaw);
 
     GLuint texture, framebuffer;
     mat4 localToWorld;
     vec3 position, normal;
     int idx;
     Portal *otherPortal;
-    Camera *c;
 
     mat4 calculateView(mat4 view);
     mat4 calculateViewNoRotation(mat4 view);
     mat4 clippedProjMat(mat4 view, mat4 proj);
+    vec4 clipPlane(vec3 viewerPosition);
+    void corners(vec3 out[4]) const;
 
     void DrawWithoutBorder(Shader *shader, mat4 view, mat4 proj);
     void DrawBorder(Shader *borderShader, mat4 view, mat4 proj);
-    void DrawPerpendicular(Shader *shader, Shader *borderShader, mat4 view, mat4 proj);
+    // faces the viewer instead, cameraYaw being the viewer's yaw in degrees at the time the draw was recorded
+    void DrawPerpendicular(Shader *shader, Shader *borderShader, mat4 view, mat4 proj, float cameraYaw);
     void Draw(Shader *shader, Shader *borderShader, mat4 view, mat4 proj);
 
 private:
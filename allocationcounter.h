@@ -0,0 +1,10 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+
+// heap allocations made through operator new on any thread since the program started. allocationcounter.cpp replaces
+// the global operator new and delete to count them, the difference across a frame shows whether it allocated at all.
+size_t heapAllocations();
+
+#endif //ALLOCATIONCOUNTER_H
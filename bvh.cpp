@@ -0,0 +1,281 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+static float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 d = boundsMax - boundsMin;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// entry distance of the ray into the box, negative when it misses or the box lies behind the origin
+static float rayBox(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &boundsMin,
+                    const glm::vec3 &boundsMax) {
+    float enter = 0.0f, leave = HUGE_VALF;
+    for (int axis = 0; axis < 3; axis++) {
+        if (std::fabs(direction[axis]) < 1e-12f) {
+            if (origin[axis] < boundsMin[axis] || origin[axis] > boundsMax[axis]) {
+                return -1.0f;
+            }
+            continue;
+        }
+        float t0 = (boundsMin[axis] - origin[axis]) / direction[axis];
+        float t1 = (boundsMax[axis] - origin[axis]) / direction[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+        if (enter > leave) {
+            return -1.0f;
+        }
+    }
+    return enter;
+}
+
+// traversal state of the queries running on this thread, kept so steady queries do not allocate
+struct QueryScratch {
+    std::vector<int> stack;
+    BoundsList batch;
+    std::vector<unsigned int> batchValues;
+    std::vector<unsigned char> visible;
+};
+
+static thread_local QueryScratch scratch;
+
+Bvh::Bvh() : root(NONE), freeList(NONE), leaves(0) {
+}
+
+int Bvh::allocate() {
+    if (freeList == NONE) {
+        nodes.emplace_back();
+        return nodes.size() - 1;
+    }
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node] = Node();
+    return node;
+}
+
+void Bvh::release(int node) {
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+int Bvh::insert(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, unsigned int value) {
+    int leaf = allocate();
+    nodes[leaf].boundsMin = boundsMin;
+    nodes[leaf].boundsMax = boundsMax;
+    nodes[leaf].insertedCenter = (boundsMin + boundsMax) * 0.5f;
+    nodes[leaf].value = value;
+    insertLeaf(leaf);
+    leaves++;
+    return leaf;
+}
+
+void Bvh::remove(int proxy) {
+    removeLeaf(proxy);
+    release(proxy);
+    leaves--;
+}
+
+void Bvh::move(int proxy, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f, size = boundsMax - boundsMin;
+    bool far = glm::length(center - nodes[proxy].insertedCenter) > std::max(size.x, std::max(size.y, size.z));
+    if (far) {
+        removeLeaf(proxy);
+    }
+    nodes[proxy].boundsMin = boundsMin;
+    nodes[proxy].boundsMax = boundsMax;
+    if (far) {
+        nodes[proxy].insertedCenter = center;
+        insertLeaf(proxy);
+    } else {
+        refit(nodes[proxy].parent);
+    }
+}
+
+void Bvh::insertLeaf(int leaf) {
+    if (root == NONE) {
+        root = leaf;
+        nodes[root].parent = NONE;
+        return;
+    }
+    // walk down towards the sibling that adds the least surface area, counting the growth of every ancestor
+    glm::vec3 leafMin = nodes[leaf].boundsMin, leafMax = nodes[leaf].boundsMax;
+    int index = root;
+    while (!nodes[index].leaf()) {
+        const Node &node = nodes[index];
+        float area = surfaceArea(node.boundsMin, node.boundsMax);
+        float combined = surfaceArea(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+        // pairing with this node pushes it down one level under a new parent
+        float cost = 2.0f * combined;
+        float inheritance = 2.0f * (combined - area);
+        float childCost[2];
+        for (int i = 0; i < 2; i++) {
+            const Node &child = nodes[node.children[i]];
+            float grown = surfaceArea(glm::min(child.boundsMin, leafMin), glm::max(child.boundsMax, leafMax));
+            childCost[i] = (child.leaf() ? grown : grown - surfaceArea(child.boundsMin, child.boundsMax)) + inheritance;
+        }
+        if (cost < childCost[0] && cost < childCost[1]) {
+            break;
+        }
+        index = node.children[childCost[0] < childCost[1] ? 0 : 1];
+    }
+
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocate();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].boundsMin = glm::min(nodes[sibling].boundsMin, leafMin);
+    nodes[newParent].boundsMax = glm::max(nodes[sibling].boundsMax, leafMax);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].children[0] = sibling;
+    nodes[newParent].children[1] = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    if (oldParent == NONE) {
+        root = newParent;
+    } else {
+        int *slot = nodes[oldParent].children[0] == sibling ? &nodes[oldParent].children[0]
+                                                             : &nodes[oldParent].children[1];
+        *slot = newParent;
+    }
+    refit(nodes[leaf].parent);
+}
+
+void Bvh::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = NONE;
+        return;
+    }
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0];
+    if (grandParent == NONE) {
+        root = sibling;
+        nodes[sibling].parent = NONE;
+        release(parent);
+        return;
+    }
+    int *slot = nodes[grandParent].children[0] == parent ? &nodes[grandParent].children[0]
+                                                          : &nodes[grandParent].children[1];
+    *slot = sibling;
+    nodes[sibling].parent = grandParent;
+    release(parent);
+    refit(grandParent);
+}
+
+void Bvh::refit(int index) {
+    while (index != NONE) {
+        index = balance(index);
+        Node &node = nodes[index];
+        const Node &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+        node.height = 1 + std::max(a.height, b.height);
+        node.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+        node.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+        index = node.parent;
+    }
+}
+
+// rotates the taller grandchild up when the children's heights differ by more than one, returns the node now at
+// a's place
+int Bvh::balance(int a) {
+    Node &A = nodes[a];
+    if (A.leaf() || A.height < 2) {
+        return a;
+    }
+    int b = A.children[0], c = A.children[1];
+    int difference = nodes[c].height - nodes[b].height;
+    if (difference > -2 && difference < 2) {
+        return a;
+    }
+    // the taller child rises, keeping the taller of its own children and handing the other one down to a
+    int up = difference > 0 ? c : b, stays = difference > 0 ? b : c;
+    Node &U = nodes[up];
+    int f = U.children[0], g = U.children[1];
+    U.children[0] = a;
+    U.parent = A.parent;
+    A.parent = up;
+    if (U.parent == NONE) {
+        root = up;
+    } else if (nodes[U.parent].children[0] == a) {
+        nodes[U.parent].children[0] = up;
+    } else {
+        nodes[U.parent].children[1] = up;
+    }
+    int keep = nodes[f].height > nodes[g].height ? f : g, give = keep == f ? g : f;
+    U.children[1] = keep;
+    A.children[difference > 0 ? 1 : 0] = give;
+    nodes[give].parent = a;
+    A.boundsMin = glm::min(nodes[stays].boundsMin, nodes[give].boundsMin);
+    A.boundsMax = glm::max(nodes[stays].boundsMax, nodes[give].boundsMax);
+    A.height = 1 + std::max(nodes[stays].height, nodes[give].height);
+    U.boundsMin = glm::min(A.boundsMin, nodes[keep].boundsMin);
+    U.boundsMax = glm::max(A.boundsMax, nodes[keep].boundsMax);
+    U.height = 1 + std::max(A.height, nodes[keep].height);
+    return up;
+}
+
+void Bvh::query(const Frustum &frustum, std::vector<unsigned int> &values) const {
+    if (root == NONE) {
+        return;
+    }
+    std::vector<int> &stack = scratch.stack;
+    BoundsList &batch = scratch.batch;
+    std::vector<unsigned int> &batchValues = scratch.batchValues;
+    std::vector<unsigned char> &visible = scratch.visible;
+    stack.assign(1, root);
+    batch.clear();
+    batchValues.clear();
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f, extent = (node.boundsMax - node.boundsMin) * 0.5f;
+        if (node.leaf()) {
+            batch.add(center, extent);
+            batchValues.push_back(node.value);
+        } else if (frustum.intersects(center, extent)) {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+        }
+    }
+    visible.resize(batch.size());
+    frustum.cull(batch, visible.data());
+    for (size_t i = 0; i < visible.size(); i++) {
+        if (visible[i]) {
+            values.push_back(batchValues[i]);
+        }
+    }
+}
+
+bool Bvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &value,
+                  float &distance) const {
+    bool hit = false;
+    distance = maxDistance;
+    if (root == NONE) {
+        return false;
+    }
+    std::vector<int> &stack = scratch.stack;
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        float t = rayBox(origin, direction, node.boundsMin, node.boundsMax);
+        if (t < 0.0f || t > distance) {
+            continue;
+        }
+        if (node.leaf()) {
+            distance = t;
+            value = node.value;
+            hit = true;
+            continue;
+        }
+        // the nearer child is searched first, so it can prune the other one
+        const Node &a = nodes[node.children[0]], &b = nodes[node.children[1]];
+        float ta = rayBox(origin, direction, a.boundsMin, a.boundsMax);
+        float tb = rayBox(origin, direction, b.boundsMin, b.boundsMax);
+        bool aFirst = tb < 0.0f || (ta >= 0.0f && ta <= tb);
+        stack.push_back(node.children[aFirst ? 1 : 0]);
+        stack.push_back(node.children[aFirst ? 0 : 1]);
+    }
+    return hit;
+}
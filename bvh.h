@@ -0,0 +1,78 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <frustum.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/**
+ * Dynamic bounding volume hierarchy over axis aligned boxes, in the style of Box2D's dynamic tree. Leaves are
+ * inserted next to the sibling that grows the tree's surface area least and every ancestor is rebalanced with tree
+ * rotations on the way up, so depth stays logarithmic without ever rebuilding.
+ *
+ * Each leaf carries a caller defined value and is addressed by the proxy insert() returns.
+ */
+class Bvh {
+public:
+    static const int NONE = -1;
+
+    Bvh();
+
+    int insert(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, unsigned int value);
+
+    void remove(int proxy);
+
+    // Updates a leaf's box and refits its ancestors. A leaf that has moved further than its own size from where it
+    // was inserted is reinserted instead, so the tree keeps grouping objects that are actually close.
+    void move(int proxy, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+    // values of the leaves intersecting the frustum, inner nodes are tested on the way down and the leaves of
+    // every visited node in one Frustum::cull batch. A portal view passes its narrowed frustum.
+    void query(const Frustum &frustum, std::vector<unsigned int> &values) const;
+
+    // nearest leaf box hit by the ray within maxDistance; direction does not need to be normalised, distance is
+    // in multiples of it
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &value,
+                 float &distance) const;
+
+    unsigned int value(int proxy) const { return nodes[proxy].value; }
+
+    size_t leafCount() const { return leaves; }
+
+    // 0 for a single leaf
+    int height() const { return root == NONE ? 0 : nodes[root].height; }
+
+private:
+    struct Node {
+        glm::vec3 boundsMin, boundsMax;
+        glm::vec3 insertedCenter; // leaves only, see move()
+        int parent = NONE;
+        int children[2] = {NONE, NONE};
+        int height = 0; // -1 while on the free list
+        unsigned int value = 0;
+
+        bool leaf() const { return children[0] == NONE; }
+    };
+
+    std::vector<Node> nodes;
+    int root;
+    int freeList; // chained through parent
+    size_t leaves;
+
+    int allocate();
+
+    void release(int node);
+
+    void insertLeaf(int leaf);
+
+    void removeLeaf(int leaf);
+
+    // refits and rebalances from node up to the root
+    void refit(int node);
+
+    int balance(int node);
+};
+
+#endif //BVH_H
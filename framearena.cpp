@@ -0,0 +1,76 @@
+#include "framearena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+LinearArena::LinearArena(size_t capacity) : memory(nullptr), size(capacity), offset(0), highWater(0) {
+    if (size > 0) {
+        memory = static_cast<unsigned char *>(::operator new(size));
+    }
+}
+
+LinearArena::~LinearArena() {
+    reset();
+    ::operator delete(memory);
+}
+
+void *LinearArena::allocate(size_t bytes, size_t alignment) {
+    // offsets stay multiples of ARENA_ALIGNMENT, larger alignments are padded for
+    size_t padding = alignment > ARENA_ALIGNMENT ? alignment - ARENA_ALIGNMENT : 0;
+    size_t rounded = (bytes + padding + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    size_t start = offset.fetch_add(rounded);
+    if (start + rounded <= size) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(memory + start);
+        return reinterpret_cast<void *>((address + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    }
+    // did not fit, the next reset() grows the block
+    void *block = ::operator new(bytes + padding);
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        overflow.push_back(block);
+    }
+    uintptr_t address = reinterpret_cast<uintptr_t>(block);
+    return reinterpret_cast<void *>((address + alignment - 1) & ~(uintptr_t) (alignment - 1));
+}
+
+void LinearArena::reset() {
+    for (void *block : overflow) {
+        ::operator delete(block);
+    }
+    overflow.clear();
+    size_t used = offset.load();
+    highWater = std::max(highWater, used);
+    if (used > size) {
+        ::operator delete(memory);
+        size = used + used / 2;
+        memory = static_cast<unsigned char *>(::operator new(size));
+    }
+    offset = 0;
+}
+
+FrameArena::FrameArena(unsigned int frames, size_t capacity) : index(0) {
+    for (unsigned int i = 0; i < frames; i++) {
+        arenas.emplace_back(new LinearArena(capacity));
+    }
+}
+
+void FrameArena::nextFrame() {
+    index = (index + 1) % arenas.size();
+    arenas[index]->reset();
+}
+
+size_t FrameArena::capacity() const {
+    size_t total = 0;
+    for (auto &arena : arenas) {
+        total += arena->capacity();
+    }
+    return total;
+}
+
+size_t FrameArena::peak() const {
+    size_t most = 0;
+    for (auto &arena : arenas) {
+        most = std::max(most, arena->peak());
+    }
+    return most;
+}
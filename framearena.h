@@ -0,0 +1,120 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// alignment of every arena allocation, enough for glm and SSE types
+const size_t ARENA_ALIGNMENT = 16;
+
+/**
+ * Bump pointer allocator over one block of memory. Allocations are an atomic add, so jobs can allocate from the same
+ * arena at once, and are only ever released all together by reset(). Nothing allocated here is destroyed, so it should
+ * only hold types that own no other memory, or own it in the same arena.
+ *
+ * When the block runs out allocations fall back to the heap until the next reset(), which then grows the block to
+ * what the frame needed, so after a few frames the arena alone serves a steady workload.
+ */
+class LinearArena {
+public:
+    explicit LinearArena(size_t capacity);
+
+    ~LinearArena();
+
+    LinearArena(const LinearArena &) = delete;
+
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment = ARENA_ALIGNMENT);
+
+    template<typename T, typename... Args>
+    T *create(Args &&... args) {
+        return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // releases everything at once; not to be called while another thread allocates
+    void reset();
+
+    // bytes handed out since the last reset, including those that did not fit
+    size_t used() const { return offset.load(); }
+
+    size_t capacity() const { return size; }
+
+    // the most any frame used
+    size_t peak() const { return highWater; }
+
+private:
+    unsigned char *memory;
+    size_t size;
+    std::atomic<size_t> offset;
+    std::mutex overflowMutex;
+    std::vector<void *> overflow; // heap blocks of allocations past the end of memory
+    size_t highWater;
+};
+
+/**
+ * One linear arena per frame in flight, used in turn. Data of a frame stays valid while later frames are recorded,
+ * until nextFrame() comes back round to its arena, so the render thread can still read it.
+ */
+class FrameArena {
+public:
+    FrameArena(unsigned int frames, size_t capacity);
+
+    // the arena of the frame being recorded
+    LinearArena &current() { return *arenas[index]; }
+
+    void *allocate(size_t size, size_t alignment = ARENA_ALIGNMENT) { return current().allocate(size, alignment); }
+
+    template<typename T, typename... Args>
+    T *create(Args &&... args) { return current().create<T>(std::forward<Args>(args)...); }
+
+    // moves on to the arena of the oldest frame and resets it, that frame must be done with by then
+    void nextFrame();
+
+    unsigned int frames() const { return arenas.size(); }
+
+    size_t capacity() const;
+
+    size_t peak() const;
+
+private:
+    std::vector<std::unique_ptr<LinearArena> > arenas;
+    unsigned int index;
+};
+
+// lets standard containers allocate from an arena; deallocation is a no-op, the memory goes with the arena's reset
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(LinearArena &arena) : arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+
+    void deallocate(T *, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+private:
+    template<typename U> friend class ArenaAllocator;
+
+    LinearArena *arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif //FRAMEARENA_H
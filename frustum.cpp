@@ -0,0 +1,129 @@
+#include "frustum.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+void BoundsList::add(const glm::vec3 &center, const glm::vec3 &extent) {
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    extentX.push_back(extent.x);
+    extentY.push_back(extent.y);
+    extentZ.push_back(extent.z);
+}
+
+void BoundsList::clear() {
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+void transformBounds(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &transform,
+                     glm::vec3 &center, glm::vec3 &extent) {
+    glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 localExtent = (boundsMax - boundsMin) * 0.5f;
+    center = glm::vec3(transform * glm::vec4(localCenter, 1.0f));
+    // the half extent along every world axis is the extent projected through the absolute rotation and scale
+    for (int axis = 0; axis < 3; axis++) {
+        extent[axis] = std::fabs(transform[0][axis]) * localExtent.x + std::fabs(transform[1][axis]) * localExtent.y
+                       + std::fabs(transform[2][axis]) * localExtent.z;
+    }
+}
+
+static glm::vec4 normalisePlane(const glm::vec4 &plane) {
+    float length = glm::length(glm::vec3(plane));
+    return length > 0.0f ? plane / length : plane;
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection) : count(0) {
+    // Gribb and Hartmann: each plane is the last row plus or minus one of the others
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row],
+                              viewProjection[3][row]);
+    }
+    for (int row = 0; row < 3; row++) {
+        addPlane(rows[3] + rows[row]);
+        addPlane(rows[3] - rows[row]);
+    }
+}
+
+void Frustum::addPlane(const glm::vec4 &plane) {
+    if (count < MAX_PLANES) {
+        planes[count++] = normalisePlane(plane);
+    }
+}
+
+void Frustum::clipToPortal(const glm::vec3 &eye, const glm::vec3 *corners, unsigned int cornerCount) {
+    glm::vec3 inside(0.0f);
+    for (unsigned int i = 0; i < cornerCount; i++) {
+        inside += corners[i] / (float) cornerCount;
+    }
+    glm::vec3 edgeNormals[MAX_PLANES];
+    for (unsigned int i = 0; i < cornerCount && i < MAX_PLANES; i++) {
+        const glm::vec3 &a = corners[i], &b = corners[(i + 1) % cornerCount];
+        glm::vec3 normal = glm::cross(a - eye, b - eye);
+        float side = glm::dot(normal, inside - eye);
+        if (std::fabs(side) < 1e-6f * glm::length(normal) * glm::length(inside - eye)) {
+            return; // eye in the portal's plane, every side plane is degenerate
+        }
+        edgeNormals[i] = side < 0.0f ? -normal : normal;
+    }
+    for (unsigned int i = 0; i < cornerCount && i < MAX_PLANES; i++) {
+        addPlane(glm::vec4(edgeNormals[i], -glm::dot(edgeNormals[i], eye)));
+    }
+}
+
+bool Frustum::intersects(const glm::vec3 &center, const glm::vec3 &extent) const {
+    for (unsigned int p = 0; p < count; p++) {
+        const glm::vec4 &plane = planes[p];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+        if (distance + radius < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Frustum::cull(const BoundsList &bounds, unsigned char *visible) const {
+    size_t total = bounds.size(), i = 0, inside = 0;
+#ifdef FRUSTUM_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= total; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]), ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]), ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 outside = zero;
+        for (unsigned int p = 0; p < count; p++) {
+            __m128 nx = _mm_set1_ps(planes[p].x), ny = _mm_set1_ps(planes[p].y), nz = _mm_set1_ps(planes[p].z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(planes[p].w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, signMask), ex),
+                                                  _mm_mul_ps(_mm_and_ps(ny, signMask), ey)),
+                                       _mm_mul_ps(_mm_and_ps(nz, signMask), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) {
+            visible[i + k] = (mask >> k & 1) == 0;
+            inside += visible[i + k];
+        }
+    }
+#endif
+    for (; i < total; i++) {
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+        visible[i] = intersects(center, extent);
+        inside += visible[i];
+    }
+    return inside;
+}
@@ -0,0 +1,64 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// world space axis aligned boxes as separate arrays of centres and half extents, so Frustum::cull can load the same
+// component of four boxes at once
+struct BoundsList {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    void add(const glm::vec3 &center, const glm::vec3 &extent);
+
+    void clear();
+
+    size_t size() const { return centerX.size(); }
+};
+
+// centre and half extent of the box around boundsMin..boundsMax after transform
+void transformBounds(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &transform,
+                     glm::vec3 &center, glm::vec3 &extent);
+
+// boxes tested and found visible in one view
+struct CullStats {
+    const char *view = "";
+    unsigned int tested = 0;
+    unsigned int visible = 0;
+};
+
+/**
+ * Planes bounding what a view can see, normals pointing inward. Starts as the six planes of a view projection matrix
+ * and can be narrowed further: by a user clip plane, and to the part of the scene visible through a portal.
+ * Boxes are tested conservatively, one that straddles a corner outside the frustum may still count as visible.
+ */
+class Frustum {
+public:
+    static const unsigned int MAX_PLANES = 12;
+
+    explicit Frustum(const glm::mat4 &viewProjection);
+
+    // keeps what lies on the positive side of a world space plane, e.g. the clipPlane of a portal view
+    void addPlane(const glm::vec4 &plane);
+
+    // keeps what eye can see through a convex polygon, given as world space corners in winding order. Leaves the
+    // frustum unchanged when eye lies in the polygon's plane.
+    void clipToPortal(const glm::vec3 &eye, const glm::vec3 *corners, unsigned int count);
+
+    bool intersects(const glm::vec3 &center, const glm::vec3 &extent) const;
+
+    // tests every box, writing 1 to visible for the boxes inside and 0 otherwise. Four boxes per step where SSE is
+    // available. Returns the number visible.
+    size_t cull(const BoundsList &bounds, unsigned char *visible) const;
+
+    unsigned int planeCount() const { return count; }
+
+private:
+    glm::vec4 planes[MAX_PLANES];
+    unsigned int count;
+};
+
+#endif //FRUSTUM_H
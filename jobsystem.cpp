@@ -0,0 +1,227 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// deque index of the current thread, 0 outside the pool
+static thread_local unsigned int currentQueue = 0;
+
+JobSystem::JobSystem(unsigned int threads) : queued(0), running(true),
+                                             epoch(std::chrono::high_resolution_clock::now()) {
+    if (threads == 0) {
+        threads = std::max(2u, std::thread::hardware_concurrency());
+    }
+    // at least one worker, so work queued by a thread that never waits still gets done
+    unsigned int workerCount = std::max(1u, threads - 1);
+    for (unsigned int i = 0; i <= workerCount; i++) {
+        queues.emplace_back(new Queue());
+    }
+    for (unsigned int i = 1; i <= workerCount; i++) {
+        workers.emplace_back(&JobSystem::work, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+JobSystem &JobSystem::shared() {
+    static JobSystem system;
+    return system;
+}
+
+unsigned int JobSystem::threadQueue() const {
+    return currentQueue < queues.size() ? currentQueue : 0;
+}
+
+void JobSystem::run(Job job, JobCounter *counter, const char *name, const JobCounter *after) {
+    if (counter) {
+        counter->pending++;
+    }
+    Task task{std::move(job), counter, name};
+    if (after) {
+        // the dependency is waited for where the job runs, that thread keeps helping meanwhile
+        Job inner = std::move(task.job);
+        task.job = [this, after, inner]() {
+            wait(*after);
+            inner();
+        };
+    }
+    Queue &queue = *queues[threadQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.pushBack(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void JobSystem::Queue::pushBack(Task &task) {
+    if (count == ring.size()) {
+        std::vector<Task> larger(std::max<size_t>(16, ring.size() * 2));
+        for (size_t i = 0; i < count; i++) {
+            larger[i] = std::move(ring[(head + i) % ring.size()]);
+        }
+        ring.swap(larger);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = std::move(task);
+    count++;
+}
+
+JobSystem::Task JobSystem::Queue::popBack() {
+    count--;
+    return std::move(ring[(head + count) % ring.size()]);
+}
+
+JobSystem::Task JobSystem::Queue::popFront() {
+    Task task = std::move(ring[head]);
+    head = (head + 1) % ring.size();
+    count--;
+    return task;
+}
+
+bool JobSystem::pop(unsigned int index, Task &task) {
+    Queue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == 0) {
+        return false;
+    }
+    task = queue.popBack();
+    queued--;
+    return true;
+}
+
+bool JobSystem::steal(unsigned int thief, Task &task) {
+    // start at a different victim on every thread so thieves do not all pile onto the same deque
+    unsigned int count = queues.size();
+    for (unsigned int i = 1; i < count; i++) {
+        Queue &queue = *queues[(thief + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.count > 0) {
+            task = queue.popFront();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Task &task, unsigned int thread) {
+    if (traceHook) {
+        auto start = std::chrono::high_resolution_clock::now();
+        task.job();
+        auto end = std::chrono::high_resolution_clock::now();
+        JobTraceEvent event{task.name, thread, std::chrono::duration<double, std::micro>(start - epoch).count(),
+                            std::chrono::duration<double, std::micro>(end - start).count()};
+        traceHook(event);
+    } else {
+        task.job();
+    }
+    if (task.counter) {
+        task.counter->pending--;
+    }
+}
+
+bool JobSystem::help() {
+    unsigned int index = threadQueue();
+    Task task;
+    if (pop(index, task) || steal(index, task)) {
+        execute(task, index);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::wait(const JobCounter &counter) {
+    while (!counter.done()) {
+        if (!help()) {
+            // the remaining jobs are running elsewhere
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body,
+                            const char *name) {
+    grain = std::max<size_t>(grain, 1);
+    if (end <= begin + grain) {
+        if (begin < end) {
+            body(begin, end);
+        }
+        return;
+    }
+    JobCounter counter;
+    // the calling thread takes the first chunk itself
+    for (size_t first = begin + grain; first < end; first += grain) {
+        size_t last = std::min(end, first + grain);
+        run([&body, first, last]() { body(first, last); }, &counter, name);
+    }
+    body(begin, begin + grain);
+    wait(counter);
+}
+
+void JobSystem::setTraceHook(TraceHook hook) {
+    traceHook = std::move(hook);
+}
+
+void JobSystem::work(unsigned int index) {
+    currentQueue = index;
+    while (true) {
+        Task task;
+        if (pop(index, task) || steal(index, task)) {
+            execute(task, index);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return queued > 0 || !running; });
+        if (!running) {
+            return;
+        }
+    }
+}
+
+JobSystem::TraceHook JobTrace::hook() {
+    return [this](const JobTraceEvent &event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    };
+}
+
+bool JobTrace::write(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::JOB_TRACE::WRITE " << path << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    file << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+        const JobTraceEvent &event = events[i];
+        file << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+             << event.thread << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+    }
+    file << "\n]}\n";
+    return true;
+}
+
+size_t JobTrace::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return events.size();
+}
+
+void JobTrace::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+}
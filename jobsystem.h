@@ -0,0 +1,136 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// jobs still pending in a group. run() adds to it and every finished job takes one off, so waiting for zero joins
+// the group. A counter lives as long as the work it tracks, typically one frame or one load.
+struct JobCounter {
+    std::atomic<int> pending{0};
+
+    bool done() const { return pending.load() == 0; }
+};
+
+// one finished job, in microseconds since the job system started
+struct JobTraceEvent {
+    const char *name;
+    unsigned int thread; // 0 for threads outside the pool
+    double start, duration;
+};
+
+/**
+ * Work-stealing job scheduler. Every worker thread owns a deque; jobs a thread queues go to the back of its own deque
+ * and it takes work from there too, newest first, while idle workers steal the oldest job from the front of another
+ * deque. Threads outside the pool share one extra deque and help with any queued work while they wait, so the
+ * caller of wait() or parallelFor() is never just blocked.
+ *
+ * The deques are mutex guarded rather than lock free: jobs here are whole meshes or thousands of objects, so a lock
+ * per job does not show.
+ */
+class JobSystem {
+public:
+    typedef std::function<void()> Job;
+    typedef std::function<void(const JobTraceEvent &)> TraceHook;
+
+    // threads 0 starts one worker less than there are cores, the caller being the last one
+    explicit JobSystem(unsigned int threads = 0);
+
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // the system shared by loaders and the frame
+    static JobSystem &shared();
+
+    // queues job, adding it to counter until it finishes. A job given a dependency waits for that counter first,
+    // helping with other work meanwhile.
+    void run(Job job, JobCounter *counter = nullptr, const char *name = "job", const JobCounter *after = nullptr);
+
+    // runs queued jobs until counter reaches zero
+    void wait(const JobCounter &counter);
+
+    // runs one queued job on the calling thread if there is any
+    bool help();
+
+    // fork/join over [begin, end) in chunks of at most grain elements, returns once body has seen every chunk. A
+    // range of one chunk runs inline.
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body,
+                     const char *name = "parallelFor");
+
+    // workers plus the calling thread
+    unsigned int threadCount() const { return workers.size() + 1; }
+
+    // called on the thread that ran each job right after it finished; nullptr turns tracing off. Set while no jobs
+    // are running.
+    void setTraceHook(TraceHook hook);
+
+private:
+    struct Task {
+        Job job;
+        JobCounter *counter;
+        const char *name;
+    };
+
+    // ring buffer that only grows, so queueing the same work every frame does not allocate
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0, count = 0;
+
+        void pushBack(Task &task);
+
+        Task popBack();
+
+        Task popFront();
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues; // queues[0] is shared by threads outside the pool
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool running;
+    TraceHook traceHook;
+    std::chrono::high_resolution_clock::time_point epoch;
+
+    // deque of the calling thread
+    unsigned int threadQueue() const;
+
+    bool pop(unsigned int queue, Task &task);
+
+    bool steal(unsigned int thief, Task &task);
+
+    void execute(Task &task, unsigned int thread);
+
+    void work(unsigned int index);
+};
+
+// collects trace events and writes them as a Chrome trace (chrome://tracing, Perfetto), one row per thread
+class JobTrace {
+public:
+    // a hook for JobSystem::setTraceHook that records into this trace
+    JobSystem::TraceHook hook();
+
+    bool write(const std::string &path) const;
+
+    size_t size() const;
+
+    void clear();
+
+private:
+    mutable std::mutex mutex;
+    std::vector<JobTraceEvent> events;
+};
+
+#endif //JOBSYSTEM_H
@@ -4,9 +4,31 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>  // for glm::fquat
 #include <Shader.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <string>
+#include <vector>
+#include "allocationcounter.h"
 #include "camera.h"
+#include "framearena.h"
+#include "frustum.h"
+#include "jobsystem.h"
 #include "Portal.h"
+#include "pool.h"
+#include "qualitygovernor.h"
+#include "renderthread.h"
+#include "scene.h"
+#include "scenefile.h"
+#include "shaderwatcher.h"
+#include "streambuffer.h"
+#include "shadervariants.h"
+#include "texturearrays.h"
+#include "texturecache.h"
+#include "texturestreamer.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define M_PI           3.14159265358979323846  /* pi */
@@ -20,11 +42,26 @@ struct CameraModel {
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
+void applyQuality(const QualitySettings &settings);
+
+void bindPortalTarget(unsigned int framebuffer);
+
+void bindScreen();
+
 int portal_intersection(glm::vec4 la, glm::vec4 lb, Portal portal);
 
 void processInput(GLFWwindow *window);
 
-void render(mat4 view, mat4 projection, vec3 cubePositions[], unsigned int BoxesVAO, mat4 globalModel = mat4(1.0f));
+void render(mat4 view, mat4 projection, unsigned int sceneVAO, mat4 globalModel = mat4(1.0f),
+            vec4 clipPlane = vec4(0.0f), Portal *portal = nullptr);
+
+void printCulling();
+
+void printMemory();
+
+// adds a command to the frame the main thread is recording, see RenderThread
+template<typename Command>
+void record(Command command);
 
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 
@@ -32,8 +69,6 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-unsigned int floorTexture;
-unsigned int floorVAO;
 // global variables used for control
 // ---------------------------------
 float lastX = (float) SCR_WIDTH / 2.0;
@@ -48,10 +83,32 @@ Camera camera(vec3(0.0f, 0.0f, 1.0f));
 
 vec3 positiveZ = vec3(0.0f, 0.0f, 1.0f);
 
+ShaderWatcher shaderWatcher;
+TextureStreamer &textureStreamer = TextureStreamer::shared();
+TextureCache &textureCache = TextureCache::shared();
+ShaderVariants *sceneShaders;
+ShaderVariants *floorShaders;
+ShaderVariants *portalShaders;
+// variants are picked once here, so draw code neither branches in GLSL nor looks programs up per frame
 Shader *ourShader;
+Shader *ourClipShader;
+Shader *floorShader;
+Shader *floorClipShader;
 Shader *portalShader;
+Shader *portalDebugShader; // tints perpendicular portals
 Shader *cameraShader;
-Shader *floorShader;
+// view matrices and instance transforms of every view, written by drawView into the frame's region. 1 MB per frame
+// holds some 16000 instances and grows when a frame needs more.
+StreamBuffer streamBuffer(1 << 20);
+
+// deepest portal recursion the renderer supports
+const int MAX_PORTAL_DEPTH = 1;
+// what the governor currently allows, applied by applyQuality
+QualitySettings quality = qualityLevels[QUALITY_LEVELS - 1];
+QualityGovernor *governor;
+// size of the default framebuffer and of the portal render targets
+int screenWidth = SCR_WIDTH, screenHeight = SCR_HEIGHT;
+int portalWidth = SCR_WIDTH, portalHeight = SCR_HEIGHT;
 
 int portalIndex = -1;
 bool didTeleport[] = {false, false};
@@ -61,29 +118,93 @@ bool portalDrawn = false;
 
 Portal *portals[2];
 CameraModel *virtualCameras[2];
+// portals and their debug cameras take fixed slots instead of heap allocations, a portal being replaced is released
+// before its successor is created
+Pool<Portal, 2> portalPool;
+Pool<CameraModel, 2> cameraPool;
+
+// the loaded level and the GPU side built from it by loadLevel. Every mesh lives in one vertex buffer behind one
+// VAO; each mesh and material pair used by an instance is a batch, and a scene object's kind is its batch.
+struct LevelBatch {
+    unsigned int mesh, material;
+};
+SceneDescription level;
+std::vector<LevelBatch> levelBatches;
+// textures stream in after startup, read their current array and layer at draw time
+std::vector<std::vector<StreamedTexture *> > levelTextures; // per material
+unsigned int levelVAO, levelVBO;
+// texture unit of each texture a program samples, see the bindSampler calls
+const int programUnits[SCENE_PROGRAM_COUNT][MAX_SCENE_TEXTURES] = {{0, 1}, {3, 3}};
+// every placed object, queried by each view's frustum and by the portal placement ray
+Scene scene;
+
+// visible instances of one batch in a view
+struct DrawPacket {
+    unsigned int batch;
+    unsigned int firstInstance, instanceCount;
+};
+
+// what render() records for the render thread to draw one view with. The packets are built by a job while the
+// frame is recorded, see buildView. Commands and their lists live in the frame arena and are never destroyed.
+struct ViewCommand {
+    mat4 view, projection, globalModel;
+    vec4 clipPlane;
+    Frustum frustum = Frustum(mat4(1.0f));
+    CullStats stats;
+    ArenaVector<unsigned int> visible; // ids the view draws
+    ArenaVector<DrawPacket> packets;
+    ArenaVector<mat4> instances; // of every packet, back to back
+
+    explicit ViewCommand(LinearArena &arena)
+            : visible(ArenaAllocator<unsigned int>(arena)), packets(ArenaAllocator<DrawPacket>(arena)),
+              instances(ArenaAllocator<mat4>(arena)) {}
+};
+// transient data of the frame being recorded. One arena for it and one for the frame the render thread may still be
+// executing, see RenderThread.
+const unsigned int FRAME_ARENA_FRAMES = 2;
+FrameArena frameArena(FRAME_ARENA_FRAMES, 256 * 1024);
+// views recorded this frame, in order, and the jobs still building their packets
+std::vector<ViewCommand *> frameViews;
+JobCounter viewJobs;
+// heap allocations of the last frame, on all threads, and how many frames did without any
+size_t frameAllocations = 0;
+unsigned int allocationFreeFrames = 0;
+
+// executes the GL side of every frame once the loop is running, see RenderThread
+RenderThread *renderThread;
+std::vector<CullStats> viewCulling; // one entry per view rendered this frame
+// the job timeline of one frame, written as a Chrome trace when T is pressed
+JobTrace frameTrace;
+bool traceFrame = false;
 
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 
 unsigned int loadTexture(int &width, int &height, const char *path);
 
-unsigned int loadTexture(char const *path);
+bool loadLevel(const char *path);
+
+void placePortal(vec3 position, vec3 normal);
 
 bool noPortalDrawn();
 
 void generateFrameBufferTexture(unsigned int &rbo, unsigned int &framebuffer, unsigned int &texture);
 
-unsigned char *loadTexture(unsigned int &texture2, int &width, int &height, int &nrChannels, char *path);
+void FBOApproach(mat4 projection, unsigned int VAO);
 
-void loadBoxTextures(unsigned int &texture1, unsigned int &texture2);
+void stencilApproach(mat4 projection, unsigned int VAO);
 
-void FBOApproach(mat4 projection, vec3 cubePositions[], unsigned int VAO);
+void generateTextureForPortals(const mat4 projection, mat4 view, unsigned int fbo, Portal *portal, unsigned int VAO,
+                               int depth);
 
-void stencilApproach(mat4 projection, vec3 cubePositions[], unsigned int VAO);
+void drawDebuggingCameras(unsigned int VAO, mat4 &projection);
 
-void generateTextureForPortals(const mat4 projection, mat4 view, vec3 *cubePositions, unsigned int fbo, Portal *portal,
-                               unsigned int VAO, int depth);
+void drawPortal(Portal *portal, mat4 view, mat4 projection, bool perpendicular);
 
-void drawDebuggingCameras(unsigned int VAO, mat4 &projection);
+void buildView(ViewCommand &command);
+
+void finishViews();
+
+void drawView(const ViewCommand &command, unsigned int sceneVAO);
 
 void disableWritingToDepthAndColor();
 
@@ -94,7 +215,41 @@ void updateDebugCameraPositions();
 
 mat4 prevView;
 
-int main() {
+// reads --swap-interval <n>, --fps-cap <fps> and --frames-in-flight <n> (see FramePacing) and --target-ms <ms> for
+// the quality governor, 0 turning it off
+bool parseArguments(int argc, char **argv, FramePacing &pacing, double &frameTimeTarget) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "ERROR::ARGUMENTS::MISSING_VALUE " << argument << std::endl;
+            return false;
+        }
+        const char *value = argv[++i];
+        if (argument == "--swap-interval") {
+            pacing.swapInterval = atoi(value);
+        } else if (argument == "--fps-cap") {
+            pacing.frameRateCap = atof(value);
+        } else if (argument == "--frames-in-flight") {
+            pacing.maxFramesInFlight = std::max(atoi(value), 1);
+        } else if (argument == "--target-ms") {
+            frameTimeTarget = atof(value);
+        } else {
+            std::cout << "ERROR::ARGUMENTS::UNKNOWN " << argument << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    FramePacing pacing;
+    double frameTimeTarget = 1000.0 / 60.0;
+    if (!parseArguments(argc, argv, pacing, frameTimeTarget)) {
+        std::cout << "usage: " << argv[0] << " [--swap-interval n] [--fps-cap fps] [--frames-in-flight n]"
+                  << " [--target-ms ms]" << std::endl;
+        return -1;
+    }
+    governor = new QualityGovernor(frameTimeTarget);
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -116,6 +271,9 @@ int main() {
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    // GL stays on this thread until the render loop starts
+    renderThread = new RenderThread(window);
+    renderThread->setPacing(pacing);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -134,152 +292,94 @@ int main() {
 
     // build and compile our shader zprogram
     // ------------------------------------
-    ourShader = new Shader("shaders/vert.shader", "shaders/scene.frag");
-    portalShader = new Shader("shaders/portal.vert", "shaders/portal.frag");
-    cameraShader = new Shader("shaders/camera.vert", "shaders/camera.frag");
-    floorShader = new Shader("shaders/floor.vert", "shaders/floor.frag");
-    // set up vertex data (and buffer(s)) and configure vertex attributess
-    // ------------------------------------------------------------------
-    float vertices[] = {
-            -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-            0.5f, -0.5f, -0.5f, 1.0f, 0.0f,
-            0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-            0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-            -0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-            -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-            -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-            0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-            0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-            0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-            -0.5f, 0.5f, 0.5f, 0.0f, 1.0f,
-            -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-
-            -0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-            -0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-            -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-            -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-            -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-            -0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-            0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-            0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-            0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-            0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-            0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-            0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-
-            -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-            0.5f, -0.5f, -0.5f, 1.0f, 1.0f,
-            0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-            0.5f, -0.5f, 0.5f, 1.0f, 0.0f,
-            -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
-            -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-
-            -0.5f, 0.5f, -0.5f, 0.0f, 1.0f,
-            0.5f, 0.5f, -0.5f, 1.0f, 1.0f,
-            0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-            0.5f, 0.5f, 0.5f, 1.0f, 0.0f,
-            -0.5f, 0.5f, 0.5f, 0.0f, 0.0f,
-            -0.5f, 0.5f, -0.5f, 0.0f, 1.0f
-    };
-    // world space positions of our cubes
-    vec3 cubePositions[] = {
-            vec3(0.0f, 0.0f, 0.0f),
-            vec3(2.0f, 5.0f, -15.0f),
-            vec3(-1.5f, -2.2f, -2.5f),
-            vec3(-3.8f, -2.0f, -12.3f),
-            vec3(2.4f, -0.4f, -3.5f),
-            vec3(-1.7f, 3.0f, -7.5f),
-            vec3(1.3f, -2.0f, -2.5f),
-            vec3(1.5f, 2.0f, -2.5f),
-            vec3(1.5f, 0.2f, -1.5f),
-            vec3(-1.3f, 1.0f, -1.5f)
-    };
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    unsigned int woodTexture;
-    unsigned int smileyTexture;
-    loadBoxTextures(woodTexture, smileyTexture);
-    floorTexture = loadTexture(R"(C:\Users\mikke\Glitter\Glitter\Glitter\Sources\tiles.jpg)");
-
-    float planeVertices[] = {
-            // positions          // texture Coords (note we set these higher than 1 (together with GL_REPEAT as texture wrapping mode). this will cause the floor texture to repeat)
-            5.0f, -0.5f, 5.0f, 2.0f, 0.0f,
-            -5.0f, -0.5f, 5.0f, 0.0f, 0.0f,
-            -5.0f, -0.5f, -5.0f, 0.0f, 2.0f,
-
-            5.0f, -0.5f, 5.0f, 2.0f, 0.0f,
-            -5.0f, -0.5f, -5.0f, 0.0f, 2.0f,
-            5.0f, -0.5f, -5.0f, 2.0f, 2.0f
-    };
-
-    // plane VAO
-    unsigned int planeVBO;
-    glGenVertexArrays(1, &floorVAO);
-    glGenBuffers(1, &planeVBO);
-    glBindVertexArray(floorVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
-    glBindVertexArray(0);
-
+    sceneShaders = new ShaderVariants("shaders/vert.shader", "shaders/scene.frag", &shaderWatcher);
+    floorShaders = new ShaderVariants("shaders/floor.vert", "shaders/floor.frag", &shaderWatcher);
+    portalShaders = new ShaderVariants("shaders/portal.vert", "shaders/portal.frag", &shaderWatcher);
+    sceneShaders->bindSampler("wood", 0);
+    sceneShaders->bindSampler("smiley", 1);
+    portalShaders->bindSampler("texture", 2);
+    floorShaders->bindSampler("tex", 3);
+    ourShader = sceneShaders->get(ShaderVariants::UBO_CAMERA | ShaderVariants::INSTANCING);
+    ourClipShader = sceneShaders->get(ShaderVariants::UBO_CAMERA | ShaderVariants::INSTANCING |
+                                      ShaderVariants::OBLIQUE_CLIP);
+    floorShader = floorShaders->get(ShaderVariants::UBO_CAMERA | ShaderVariants::INSTANCING);
+    floorClipShader = floorShaders->get(ShaderVariants::UBO_CAMERA | ShaderVariants::INSTANCING |
+                                        ShaderVariants::OBLIQUE_CLIP);
+    portalShader = portalShaders->get(ShaderVariants::TEXTURED);
+    portalDebugShader = portalShaders->get(ShaderVariants::TEXTURED | ShaderVariants::DEBUG_COLOUR);
+    cameraShader = portalShaders->get(0);
+    // compiling and linking continues in the driver while we upload geometry and textures below
+    std::vector<Shader *> programs = {ourShader, ourClipShader, floorShader, floorClipShader, portalShader,
+                                      portalDebugShader, cameraShader};
+
+    // view and projection shared by the scene programs (see ShaderVariants::UBO_CAMERA) and the instance matrices
+    // come from the stream buffer, each view binds its own range
+    streamBuffer.create();
+    // geometry, textures, instances and starting portals all come from the level file
+    if (!loadLevel("resources/level.scene")) {
+        glfwTerminate();
+        return -1;
+    }
 
-    ourShader->use();
-    ourShader->setInt("wood", 0);
-    ourShader->setInt("smiley", 1);
+    // keep presenting a placeholder frame until every program has linked, instead of blocking on the first use()
+    // ---------------------------------------------------------------------------------------------------------
+    while (!Shader::allReady(programs) && !glfwWindowShouldClose(window)) {
+        textureStreamer.update();
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+    ShaderCache::report();
+    shaderWatcher.start();
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     // -------------------------------------------------------------------------------------------
 
     // render loop
     // -----------
+    // from here on this thread records frames and the render thread owns the context
+    renderThread->start();
     mat4 projection = perspective(radians(45.0f), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-    ourShader->use();
-    ourShader->setMat4("projection", projection);
-    portalShader->use();
-    portalShader->setMat4("projection", projection);
-    portalShader->setInt("texture", 2);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, woodTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, smileyTexture);
     int frame = 0;
     while (!glfwWindowShouldClose(window)) {
+        // input was polled at the end of the last iteration, this frame is what reacts to it
+        RenderThread::Clock::time_point inputTime = RenderThread::Clock::now();
+        size_t allocationsBefore = heapAllocations();
+        frameArena.nextFrame();
+        bool tracing = traceFrame;
+        if (tracing) {
+            frameTrace.clear();
+            JobSystem::shared().setTraceHook(frameTrace.hook());
+            traceFrame = false;
+        }
+        record([] {
+            streamBuffer.beginFrame();
+            // swap in edited shaders between frames, portals and camera state are untouched
+            shaderWatcher.applyChanges();
+            // upload the next slice of any textures still streaming in, within the per frame budget
+            textureStreamer.update();
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        });
         processInput(window);
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        // rebuilds only what moved, nothing for the static level
+        scene.update();
+        viewCulling.clear();
 
         prevView = camera.GetViewMatrix();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         if (!stencilBuffer) {
-            FBOApproach(projection, cubePositions, VAO);
+            FBOApproach(projection, levelVAO);
         } else {
-            stencilApproach(projection, cubePositions, VAO);
+            stencilApproach(projection, levelVAO);
         }
         if (debug) {
             updateDebugCameraPositions();
         }
-        drawDebuggingCameras(VAO, projection);
+        drawDebuggingCameras(levelVAO, projection);
         if (debug) {
             if (portals[0] != NULL && portals[1] != NULL) {
                 for (auto portal : portals) {
@@ -331,14 +431,63 @@ int main() {
                }
            }
            **/
-        glfwSwapBuffers(window);
+        // the render thread executes and presents this frame while the next one is simulated and recorded
+        finishViews();
+        // the slowest of recording, issuing and GPU work decides what the next frames can afford
+        double recordTime = std::chrono::duration<double, std::milli>(
+                RenderThread::Clock::now() - inputTime).count();
+        double frameTime = std::max(recordTime, std::max(renderThread->executeFrameTime(),
+                                                         renderThread->gpuFrameTime()));
+        if (governor->update(frameTime)) {
+            applyQuality(governor->settings());
+        }
+        record([] { streamBuffer.endFrame(); });
+        renderThread->submit(inputTime);
+        if (tracing) {
+            JobSystem::shared().setTraceHook(nullptr);
+            if (frameTrace.write("frame.trace.json")) {
+                std::cout << "Frame trace: " << frameTrace.size() << " jobs written to frame.trace.json" << std::endl;
+            }
+        }
         glfwPollEvents();
+        frameAllocations = heapAllocations() - allocationsBefore;
+        if (frameAllocations == 0) {
+            allocationFreeFrames++;
+        }
     }
+    renderThread->stop();
+    const RenderThread::Stats &renderStats = renderThread->stats();
+    if (renderStats.frames > 0) {
+        std::cout << "Render thread: " << renderStats.frames << " frames, "
+                  << renderStats.executeTime / renderStats.frames << " ms to execute, main thread waited "
+                  << renderStats.submitWait / renderStats.frames << " ms per frame" << std::endl;
+        std::cout << "Pacing: swap interval " << pacing.swapInterval << ", cap " << pacing.frameRateCap
+                  << " fps, " << pacing.maxFramesInFlight << " frames in flight; slept "
+                  << renderStats.paceSleep / renderStats.frames << " ms and waited for the GPU "
+                  << renderStats.gpuWait / renderStats.frames << " ms per frame" << std::endl;
+        std::cout << "Latency: input to swap " << renderStats.swapLatency / renderStats.frames << " ms";
+        if (renderStats.gpuLatencyFrames > 0) {
+            std::cout << ", input to GPU done at most " << renderStats.gpuLatency / renderStats.gpuLatencyFrames
+                      << " ms (worst " << renderStats.maxGpuLatency << " ms)";
+        }
+        std::cout << std::endl;
+    }
+    printMemory();
+    std::cout << "Quality: level " << governor->level() << " of " << QUALITY_LEVELS - 1 << " after "
+              << governor->decisions().size() << " changes" << std::endl;
+    const StreamBuffer::Stats &streamStats = streamBuffer.stats();
+    std::cout << "Stream buffer: " << (streamBuffer.persistent() ? "persistent" : "orphaned") << ", "
+              << streamStats.peak / 1024.0 << " KB at most per frame, waited for the GPU " << streamStats.fenceWaits
+              << " times (" << streamStats.waitTime << " ms), grown " << streamStats.overflows << " times"
+              << std::endl;
 
 // optional: de-allocate all resources once they've outlived their purpose:
 // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &levelVAO);
+    glDeleteBuffers(1, &levelVBO);
+    streamBuffer.destroy();
+    shaderWatcher.stop();
+    textureStreamer.shutdown();
 
 // glfw: terminate, clearing all previously allocated GLFW resources.
 // ------------------------------------------------------------------
@@ -354,7 +503,7 @@ void updateDebugCameraPositions() {
             if (virtualCameras[portal->idx] != nullptr) {
                 portalCamera = virtualCameras[portal->idx];
             } else {
-                portalCamera = new CameraModel();
+                portalCamera = cameraPool.create();
             }
             mat4 model = mat4(1.0f);
             model = translate(model, vec3(camera.Position));
@@ -366,9 +515,15 @@ void updateDebugCameraPositions() {
 }
 
 void drawDebuggingCameras(unsigned int VAO, mat4 &projection) {
+    // the level's cube stands in for the camera body
+    int cube = level.findMesh("cube");
+    if (cube < 0) {
+        return;
+    }
+    GLint first = level.meshes[cube].firstVertex;
+    GLsizei count = level.meshes[cube].vertexCount;
     for (auto &portal : portals) {
         if (portal != nullptr && virtualCameras[portal->idx] != nullptr) {
-            cameraShader->use();
             /**
              * First portals camera is blue, other is red.
             */
@@ -378,69 +533,82 @@ void drawDebuggingCameras(unsigned int VAO, mat4 &projection) {
             } else {
                 color = vec3(1, 0, 0);
             }
-            cameraShader->setVec3("color", color);
             virtualCameras[portal->idx]->view = portal->calculateView(camera.GetViewMatrix());
-            cameraShader->setMat4("view", virtualCameras[portal->idx]->view);
-            cameraShader->setMat4("projection", projection);
-            cameraShader->setMat4("model", virtualCameras[portal->idx]->model);
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            cameraShader->setMat4("model", translate(scale(virtualCameras[portal->idx]->model, vec3(0.5, 0.5, 0.5)),
-                                                     vec3(0.0f, 0.f, -1)));
-            cameraShader->setVec3("color", color + vec3(0.5, 0.5, 0.5));
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            mat4 view = virtualCameras[portal->idx]->view, model = virtualCameras[portal->idx]->model;
+            record([=] {
+                cameraShader->use();
+                cameraShader->setVec3(Shader::COLOR, color);
+                cameraShader->setMat4(Shader::VIEW, view);
+                cameraShader->setMat4(Shader::PROJECTION, projection);
+                cameraShader->setMat4(Shader::MODEL, model);
+                glBindVertexArray(VAO);
+                glDrawArrays(GL_TRIANGLES, first, count);
+                cameraShader->setMat4(Shader::MODEL, translate(scale(model, vec3(0.5, 0.5, 0.5)), vec3(0.0f, 0.f, -1)));
+                cameraShader->setVec3(Shader::COLOR, color + vec3(0.5, 0.5, 0.5));
+                glDrawArrays(GL_TRIANGLES, first, count);
+            });
             // camera/view localToWorld
         }
     }
 }
 
-void recursiveStencil(mat4 view, mat4 projection, vec3 cubePositions[], unsigned int VAO, int depth) {
-    if (depth >= 2) {
+void recursiveStencil(mat4 view, mat4 projection, unsigned int VAO, int depth) {
+    if (depth > MAX_PORTAL_DEPTH) {
         return;
     }
-    if (portals[0] != NULL && portals[1] != NULL) {
+    // below the governor's depth the portals are drawn as plain frames
+    if (portals[0] != NULL && portals[1] != NULL && depth < quality.portalDepth) {
         //Now, we have for
         for (int i = 0; i < 2; i++) {
             auto *p = portals[i];
-            //Setup the stencil test, write 1's inside the portal frame
-            glEnable(GL_STENCIL_TEST);
-            glStencilMask(0xFF);
-            glStencilFunc(GL_NEVER, depth + i + 1, 0xFF);
-            glStencilOp(GL_REPLACE, GL_KEEP, GL_KEEP);
-            //We are only interested in carving a hole, so remove depth test and depth color writing
-            disableWritingToDepthAndColor();
-            p->DrawWithoutBorder(ourShader, view, projection);
-            //Then, enable the depth test, to get a correct rendering. Remember we only update depth
-            //on the values that are actually "valid". But, yes, we clear the entire depth buffer
-            enableWritingToDepthAndColor();
-            glEnable(GL_DEPTH_TEST);
-            glStencilFunc(GL_EQUAL, depth + i + 1, 0xFF);
-            glStencilMask(0x00);
+            // commands look portals up by index when they run, see placePortal
+            record([=] {
+                //Setup the stencil test, write 1's inside the portal frame
+                glEnable(GL_STENCIL_TEST);
+                glStencilMask(0xFF);
+                glStencilFunc(GL_NEVER, depth + i + 1, 0xFF);
+                glStencilOp(GL_REPLACE, GL_KEEP, GL_KEEP);
+                //We are only interested in carving a hole, so remove depth test and depth color writing
+                disableWritingToDepthAndColor();
+                portals[i]->DrawWithoutBorder(cameraShader, view, projection);
+                //Then, enable the depth test, to get a correct rendering. Remember we only update depth
+                //on the values that are actually "valid". But, yes, we clear the entire depth buffer
+                enableWritingToDepthAndColor();
+                glEnable(GL_DEPTH_TEST);
+                glStencilFunc(GL_EQUAL, depth + i + 1, 0xFF);
+                glStencilMask(0x00);
+            });
             mat4 newProj = perspective(radians(45.0f), (float) SCR_WIDTH / (float) SCR_HEIGHT,
                                        distance(camera.Position, p->position), 100.0f);
-            render(p->calculateView(view), newProj, cubePositions, VAO, mat4(1.0f));
-            //recursiveStencil(p->calculateView(view), projection, cubePositions, VAO, depth +1);
-        }
-        glDisable(GL_STENCIL_TEST);
-        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        for (auto portal : portals) {
-            portal->DrawWithoutBorder(cameraShader, view, projection);
+            render(p->calculateView(view), newProj, VAO, mat4(1.0f), p->clipPlane(camera.Position), p);
+            //recursiveStencil(p->calculateView(view), projection, VAO, depth +1);
         }
+        record([=] {
+            glDisable(GL_STENCIL_TEST);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            for (auto portal : portals) {
+                portal->DrawWithoutBorder(cameraShader, view, projection);
+            }
+        });
     }
-    glStencilFunc(GL_EQUAL, depth, 0xFF);
-    glEnable(GL_DEPTH_TEST);
-    enableWritingToDepthAndColor();
-    render(view, projection, cubePositions, VAO, mat4(1.0f));
-    for (auto portal : portals) {
-        if (portal != NULL && portal->otherPortal == NULL) {
-            cameraShader->use();
-            cameraShader->setVec3("color", vec3(0, 0, 0));
-            portal->Draw(cameraShader, cameraShader, view, projection);
-        } else if (portal != NULL && portal->otherPortal != NULL) {
-            portal->DrawBorder(cameraShader, view, projection);
+    record([=] {
+        glStencilFunc(GL_EQUAL, depth, 0xFF);
+        glEnable(GL_DEPTH_TEST);
+        enableWritingToDepthAndColor();
+    });
+    render(view, projection, VAO, mat4(1.0f));
+    record([=] {
+        for (auto portal : portals) {
+            if (portal != NULL && portal->otherPortal == NULL) {
+                cameraShader->use();
+                cameraShader->setVec3(Shader::COLOR, vec3(0, 0, 0));
+                portal->Draw(cameraShader, cameraShader, view, projection);
+            } else if (portal != NULL && portal->otherPortal != NULL) {
+                portal->DrawBorder(cameraShader, view, projection);
+            }
         }
-    }
+    });
 }
 
 /**
@@ -496,39 +664,34 @@ void disableWritingToDepthAndColor() {
     glDepthMask(GL_FALSE);
 }
 
-void stencilApproach(mat4 projection, vec3 cubePositions[], unsigned int VAO) {
-    glEnable(GL_STENCIL_TEST);
-    recursiveStencil(camera.GetViewMatrix(), projection, cubePositions, VAO, 0);
-    glStencilMask(0xFF); // each bit is written to the stencil buffer as is
-    glDisable(GL_STENCIL_TEST);
+void stencilApproach(mat4 projection, unsigned int VAO) {
+    record([] { glEnable(GL_STENCIL_TEST); });
+    recursiveStencil(camera.GetViewMatrix(), projection, VAO, 0);
+    record([] {
+        glStencilMask(0xFF); // each bit is written to the stencil buffer as is
+        glDisable(GL_STENCIL_TEST);
+    });
 }
 
 
-void FBOApproach(mat4 projection, vec3 cubePositions[], unsigned int VAO) {
+void FBOApproach(mat4 projection, unsigned int VAO) {
+    mat4 view = camera.GetViewMatrix();
     if (!showBluePortalsCamera) {
+        // at depth 0 the portals keep showing the views they were last rendered with
         for (auto &portal : portals) {
-            if (portal != nullptr && portal->otherPortal != nullptr) {
-                glBindFramebuffer(GL_FRAMEBUFFER, portal->framebuffer);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            if (portal != nullptr && portal->otherPortal != nullptr && quality.portalDepth > 0) {
+                bindPortalTarget(portal->framebuffer);
                 mat4 newProj = perspective(radians(45.0f), (float) SCR_WIDTH / (float) SCR_HEIGHT,
                                            distance(camera.Position, portal->position), 100.0f);
-                generateTextureForPortals(newProj, portal->calculateView(camera.GetViewMatrix()), cubePositions,
-                                          portal->framebuffer, portal, VAO, 0);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0); // back to default
+                generateTextureForPortals(newProj, portal->calculateView(view), portal->framebuffer, portal, VAO, 0);
+                bindScreen();
             }
         }
         // second pass
-        render(camera.GetViewMatrix(), projection, cubePositions, VAO, mat4(1.0f));
+        render(view, projection, VAO, mat4(1.0f));
         for (auto &portal : portals) {
-            glActiveTexture(GL_TEXTURE2);
             if (portal != nullptr) {
-                glBindTexture(GL_TEXTURE_2D, portal->texture);
-                if (debug) {
-                    portal->DrawPerpendicular(portalShader, cameraShader, camera.GetViewMatrix(), projection);
-                }
-                else {
-                    portal->Draw(portalShader, cameraShader, camera.GetViewMatrix(), projection);
-                }
+                drawPortal(portal, view, projection, debug);
             }
         }
     } else
@@ -536,38 +699,47 @@ void FBOApproach(mat4 projection, vec3 cubePositions[], unsigned int VAO) {
          * Render from point of view of blue portal
          */
     {
-        mat4 finalView = portals[0]->calculateView(camera.GetViewMatrix());
+        mat4 finalView = portals[0]->calculateView(view);
         //mat4 projection = portal->clippedProjMat(finalView, projection);
-        render(finalView, projection, cubePositions, VAO, mat4(1.0f));
+        render(finalView, projection, VAO, mat4(1.0f), portals[0]->clipPlane(camera.Position),
+               portals[0]);
         if (debug) {
             for (auto &portal : portals) {
-                glBindFramebuffer(GL_FRAMEBUFFER, portal->framebuffer);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-                generateTextureForPortals(projection, portal->calculateView(camera.GetViewMatrix()), cubePositions,
-                                          portal->framebuffer, portal, VAO, 0);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0); // back to default
-                glActiveTexture(GL_TEXTURE2);
+                bindPortalTarget(portal->framebuffer);
+                generateTextureForPortals(projection, portal->calculateView(view), portal->framebuffer, portal, VAO, 0);
+                bindScreen();
                 if (portal != nullptr) {
-                    glBindTexture(GL_TEXTURE_2D, portal->texture);
-                    if (debug) {
-                        portal->DrawPerpendicular(portalShader, cameraShader, camera.GetViewMatrix(), projection);
-                    }
-                    else {
-                        portal->Draw(portalShader, cameraShader, camera.GetViewMatrix(), projection);
-                    }
+                    drawPortal(portal, view, projection, debug);
                 }
             }
         }
     }
 }
 
-void generateTextureForPortals(const mat4 projection, mat4 view, vec3 *cubePositions, unsigned int fbo, Portal *portal,
-                               unsigned int VAO, int depth) {
-    if (depth > 1) {
+// records drawing portal with the texture its view was rendered into, perpendicular when debugging
+void drawPortal(Portal *portal, mat4 view, mat4 projection, bool perpendicular) {
+    // the render thread never reads the camera, which this thread moves while the frame executes
+    float cameraYaw = camera.Yaw;
+    int index = portal->idx;
+    record([=] {
+        Portal *p = portals[index];
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, p->texture);
+        if (perpendicular) {
+            p->DrawPerpendicular(portalDebugShader, cameraShader, view, projection, cameraYaw);
+        } else {
+            p->Draw(portalShader, cameraShader, view, projection);
+        }
+    });
+}
+
+void generateTextureForPortals(const mat4 projection, mat4 view, unsigned int fbo, Portal *portal, unsigned int VAO,
+                               int depth) {
+    if (depth > MAX_PORTAL_DEPTH) {
         return;
     }
     //mat4 projection = portal->clippedProjMat(finalView, projection);
-    render(view, projection, cubePositions, VAO, mat4(1.0f));
+    render(view, projection, VAO, mat4(1.0f), portal->clipPlane(camera.Position), portal);
     if (debug) {
         /**
          *
@@ -575,54 +747,72 @@ void generateTextureForPortals(const mat4 projection, mat4 view, vec3 *cubePosit
         unsigned int framebuffer, portalTexture, rbo;
         generateFrameBufferTexture(rbo, framebuffer, portalTexture);
          */
-        glActiveTexture(GL_TEXTURE2);
         //glBindTexture(GL_TEXTURE_2D, portal->otherPortal->texture);
-        glBindTexture(GL_TEXTURE_2D, portal->texture);
-        portal->Draw(portalShader, cameraShader, view, projection);
+        drawPortal(portal, view, projection, false);
     }
 }
 
-void loadBoxTextures(unsigned int &texture1, unsigned int &texture2) {// load and create a texture
-// -------------------------
-    int width, height, nrChannels;
-    // ---------
-    stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-    unsigned char *data = loadTexture(texture1, width, height, nrChannels,
-                                      "resources/container.jpg");
-    if (data) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-    // texture 2
-// ---------
-    data = loadTexture(texture2, width, height, nrChannels,
-                       "resources/awesomeface.png");
-    if (data) {
-        // note that the awesomeface.png has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture" << std::endl;
+// reads the level description and builds everything it needs on the GPU at once: a single upload for the vertices of
+// every mesh, one texture request per material texture, and the scene objects and portals it places
+bool loadLevel(const char *path) {
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!loadSceneFile(path, level)) {
+        return false;
     }
-    stbi_image_free(data);
-}
+    glGenVertexArrays(1, &levelVAO);
+    glGenBuffers(1, &levelVBO);
+    glBindVertexArray(levelVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, levelVBO);
+    glBufferData(GL_ARRAY_BUFFER, level.vertices.size() * sizeof(float), level.vertices.data(), GL_STATIC_DRAW);
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, SCENE_VERTEX_FLOATS * sizeof(float), (void *) 0);
+    glEnableVertexAttribArray(0);
+    // texture coord attribute
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, SCENE_VERTEX_FLOATS * sizeof(float), (void *) (3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    // instance model matrix, one column per location, pointed at each view's range of the stream buffer by drawView
+    glBindBuffer(GL_ARRAY_BUFFER, streamBuffer.buffer());
+    for (unsigned int column = 0; column < 4; column++) {
+        glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void *) (column * sizeof(vec4)));
+        glEnableVertexAttribArray(2 + column);
+        glVertexAttribDivisor(2 + column, 1);
+    }
+    glBindVertexArray(0);
 
-unsigned char *loadTexture(unsigned int &texture2, int &width, int &height, int &nrChannels, char *path) {
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and generate mipmaps
-    unsigned char *data = stbi_load(path, &width, &height, &nrChannels,
-                                    0);
-    return data;
+    // decoded on the streamer's worker threads, flipped on the y-axis there
+    for (auto &material : level.materials) {
+        levelTextures.emplace_back();
+        for (unsigned int t = 0; t < material.textureCount; t++) {
+            levelTextures.back().push_back(textureCache.acquire(material.textures[t], false, true));
+        }
+    }
+    for (auto &instance : level.instances) {
+        unsigned int batch = 0;
+        while (batch < levelBatches.size() &&
+               (levelBatches[batch].mesh != instance.mesh || levelBatches[batch].material != instance.material)) {
+            batch++;
+        }
+        if (batch == levelBatches.size()) {
+            levelBatches.push_back({instance.mesh, instance.material});
+        }
+        const SceneFileMesh &mesh = level.meshes[instance.mesh];
+        const float *r = instance.rotation;
+        scene.add(vec3(instance.position[0], instance.position[1], instance.position[2]), quat(r[3], r[0], r[1], r[2]),
+                  vec3(instance.scale[0], instance.scale[1], instance.scale[2]),
+                  vec3(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]),
+                  vec3(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]), batch);
+    }
+    for (auto &pair : level.portals) {
+        for (int end = 0; end < 2; end++) {
+            placePortal(vec3(pair.position[end][0], pair.position[end][1], pair.position[end][2]),
+                        normalize(vec3(pair.normal[end][0], pair.normal[end][1], pair.normal[end][2])));
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Level " << path << ": " << level.meshes.size() << " meshes, " << level.instances.size()
+              << " instances in " << levelBatches.size() << " batches, " << level.memory() / 1024.0 << " KB ("
+              << elapsed.count() << " ms)" << std::endl;
+    return true;
 }
 
 void generateFrameBufferTexture(unsigned int &rbo, unsigned int &framebuffer, unsigned int &texture) {
@@ -631,7 +821,7 @@ void generateFrameBufferTexture(unsigned int &rbo, unsigned int &framebuffer, un
     // generate texture
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, portalWidth, portalHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     float borderColor[] = {0.8f, 0.2f, 0.0f, 1.0f};
@@ -641,44 +831,156 @@ void generateFrameBufferTexture(unsigned int &rbo, unsigned int &framebuffer, un
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
     glGenRenderbuffers(1, &rbo);
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH,
-                          SCR_HEIGHT); // use a single renderbuffer object for both a depth AND stencil buffer.
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, portalWidth,
+                          portalHeight); // use a single renderbuffer object for both a depth AND stencil buffer.
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
                               rbo); // now actually attach it
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void render(mat4 view, mat4 projection, vec3 cubePositions[], unsigned int BoxesVAO, mat4 globalModel) {
+// portal is the one this view is seen through; the view is then narrowed to what shows through its other end
+// Views only depend on their own matrices and the scene, which does not change while the frame is recorded, so each
+// view's culling and packets are built by a job and the draw is recorded in its place straight away. finishViews()
+// joins the jobs before the frame is submitted.
+void render(mat4 view, mat4 projection, unsigned int sceneVAO, mat4 globalModel, vec4 clipPlane, Portal *portal) {
+    ViewCommand *command = frameArena.create<ViewCommand>(frameArena.current());
+    command->view = view;
+    command->projection = projection;
+    command->globalModel = globalModel;
+    command->clipPlane = clipPlane;
+    // skip what this view cannot see
+    command->frustum = Frustum(projection * view);
+    if (clipPlane != vec4(0.0f)) {
+        command->frustum.addPlane(clipPlane);
+    }
+    if (portal != nullptr && portal->otherPortal != nullptr) {
+        vec3 corners[4];
+        portal->otherPortal->corners(corners);
+        command->frustum.clipToPortal(vec3(inverse(view)[3]), corners, 4);
+    }
+    command->stats.view = portal != nullptr ? "portal" : "main";
+    frameViews.push_back(command);
+    JobSystem::shared().run([command] { buildView(*command); }, &viewJobs, "buildView");
+    record([=] { drawView(*command, sceneVAO); });
+}
+
+// culls the scene against the view's frustum and groups what is left into one packet per batch
+void buildView(ViewCommand &command) {
+    command.stats.tested = scene.size();
+    // queried into a list kept by the worker, then copied into the frame arena
+    static thread_local std::vector<unsigned int> visible;
+    visible.clear();
+    // the tree holds bounds without globalModel, draw everything when it moves the scene
+    if (command.globalModel == mat4(1.0f)) {
+        scene.query(command.frustum, visible);
+    } else {
+        scene.all(visible);
+    }
+    command.visible.assign(visible.begin(), visible.end());
+    command.stats.visible = command.visible.size();
+    std::sort(command.visible.begin(), command.visible.end(), [](unsigned int a, unsigned int b) {
+        return scene.object(a).kind < scene.object(b).kind;
+    });
+    command.packets.reserve(levelBatches.size());
+    command.instances.reserve(command.visible.size());
+    for (unsigned int id : command.visible) {
+        unsigned int kind = scene.object(id).kind;
+        if (command.packets.empty() || command.packets.back().batch != kind) {
+            command.packets.push_back({kind, (unsigned int) command.instances.size(), 0});
+        }
+        command.packets.back().instanceCount++;
+        command.instances.push_back(scene.model(id));
+    }
+}
+
+// waits for the packets of every view recorded this frame, helping to build them
+void finishViews() {
+    JobSystem::shared().wait(viewJobs);
+    for (auto &command : frameViews) {
+        viewCulling.push_back(command->stats);
+    }
+    frameViews.clear();
+}
+
+// render thread side of render()
+void drawView(const ViewCommand &command, unsigned int sceneVAO) {
     // render
     // ------
-    // bind textures on corresponding texture units
-    // activate shader
-    ourShader->use();
-    // camera/view localToWorld
-    ourShader->setMat4("view", view);
-    ourShader->setMat4("projection", projection);
-    // render boxes
-    glBindVertexArray(BoxesVAO);
-    for (unsigned int i = 0; i < 10; i++) {
-        // calculate the model matrix for each object and pass it to shader before drawing
-        mat4 model = mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        model = translate(model, cubePositions[i]);
-        float angle = 20.0f * i;
-        model = rotate(model, radians(angle), vec3(1.0f, 0.3f, 0.5f));
-        ourShader->setMat4("model", model * globalModel);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-    }
-    floorShader->use();
-    floorShader->setMat4("view", view);
-    floorShader->setMat4("projection", projection);
-    floorShader->setMat4("model", glm::mat4(1.0f) * globalModel);
-    glBindVertexArray(floorVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, floorTexture);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    // the Camera block and every packet's instances go into the stream buffer back to back, written in place
+    const size_t cameraBlock = 2 * sizeof(mat4);
+    size_t instanceBytes = command.instances.size() * sizeof(mat4);
+    GLintptr offset;
+    unsigned char *data = (unsigned char *) streamBuffer.map(cameraBlock + instanceBytes,
+                                                             streamBuffer.uniformAlignment(), offset);
+    if (data == nullptr) {
+        std::cout << "ERROR::STREAMBUFFER::MAP_FAILED" << std::endl;
+        return;
+    }
+    memcpy(data, &command.view[0][0], sizeof(mat4));
+    memcpy(data + sizeof(mat4), &command.projection[0][0], sizeof(mat4));
+    memcpy(data + cameraBlock, command.instances.data(), instanceBytes);
+    streamBuffer.unmap();
+    glBindBufferRange(GL_UNIFORM_BUFFER, ShaderVariants::CAMERA_BLOCK_BINDING, streamBuffer.buffer(), offset,
+                      cameraBlock);
+    // portal views clip away everything between the virtual camera and the destination portal
+    bool clip = command.clipPlane != vec4(0.0f);
+    Shader *programs[SCENE_PROGRAM_COUNT] = {clip ? ourClipShader : ourShader, clip ? floorClipShader : floorShader};
+    if (clip) {
+        glEnable(GL_CLIP_DISTANCE0);
+    }
+    // uniforms that are the same for the whole view are set once per program, not per packet
+    for (Shader *shader : programs) {
+        shader->use();
+        shader->setVec4(Shader::CLIP_PLANE, command.clipPlane);
+        // the shader applies the instance matrix after model
+        shader->setMat4(Shader::MODEL, command.globalModel);
+    }
+    // each draw points the instance attribute at its own range
+    glBindVertexArray(sceneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, streamBuffer.buffer());
+    for (const DrawPacket &packet : command.packets) {
+        const LevelBatch &batch = levelBatches[packet.batch];
+        const SceneFileMesh &mesh = level.meshes[batch.mesh];
+        uint32_t program = level.materials[batch.material].program;
+        // bind textures on corresponding texture units
+        // scene textures live in shared arrays, so after the first view these binds are skipped
+        ivec4 layers(0);
+        const std::vector<StreamedTexture *> &textures = levelTextures[batch.material];
+        for (unsigned int t = 0; t < textures.size(); t++) {
+            TextureArrays::bind(programUnits[program][t], textures[t]->array);
+            layers[t] = textures[t]->layer;
+        }
+        // activate shader
+        Shader *shader = programs[program];
+        shader->use();
+        shader->setIVec4(Shader::MATERIAL_LAYERS, layers);
+        for (unsigned int column = 0; column < 4; column++) {
+            size_t attribute = offset + cameraBlock + packet.firstInstance * sizeof(mat4) + column * sizeof(vec4);
+            glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void *) attribute);
+        }
+        glDrawArraysInstanced(GL_TRIANGLES, mesh.firstVertex, mesh.vertexCount, packet.instanceCount);
+    }
     glBindVertexArray(0);
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    // -------------------------------------------------------------------------------
+    if (clip) {
+        glDisable(GL_CLIP_DISTANCE0);
+    }
+}
+
+// heap allocations of the last frame next to what the frame arenas hold
+void printMemory() {
+    std::cout << "Memory: " << frameAllocations << " heap allocations last frame, " << allocationFreeFrames
+              << " frames without, frame arena " << frameArena.peak() / 1024.0 << " of "
+              << frameArena.capacity() / frameArena.frames() / 1024.0 << " KB, render commands "
+              << renderThread->commands().memory() / 1024.0 << " KB" << std::endl;
+}
+
+// objects each view of the last frame drew, out of those it tested
+void printCulling() {
+    std::cout << "Culling:";
+    for (auto &stats : viewCulling) {
+        std::cout << " " << stats.view << " " << stats.visible << "/" << stats.tested;
+    }
+    std::cout << " visible" << std::endl;
 }
 
 bool noPortalDrawn() { return portalIndex < 0; }
@@ -715,31 +1017,65 @@ void processInput(GLFWwindow *window) {
         showBluePortalsCamera = true;
     if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
         showBluePortalsCamera = false;
+    // once per press, reports the frame before it
+    static bool cullingKeyDown = false;
+    bool cullingKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cullingKey && !cullingKeyDown)
+        printCulling();
+    cullingKeyDown = cullingKey;
+    static bool traceKeyDown = false;
+    bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (traceKey && !traceKeyDown)
+        traceFrame = true;
+    traceKeyDown = traceKey;
+    static bool memoryKeyDown = false;
+    bool memoryKey = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memoryKey && !memoryKeyDown)
+        printMemory();
+    memoryKeyDown = memoryKey;
 
 }
 
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        // one unit ahead, or just short of the first object in the way so the portal does not end up inside it
+        float reach = 1.0f;
+        unsigned int hit;
+        if (scene.raycast(camera.Position, camera.Front, 1.0f, hit, reach)) {
+            reach = std::max(reach - 0.1f, 0.0f);
+        }
+        vec3 position = camera.Position + camera.Front * reach;
+        placePortal(vec3(position.x, 0.50, position.z), camera.Front);
+    }
+}
+
+// replaces the older portal of the pair, linked to the one placed before it. normal is the direction it was placed
+// in, the camera's front for a click or the one a level gives. Recorded commands refer to portals by their index in
+// portals, and call() only runs once the submitted frame is done with them.
+void placePortal(vec3 position, vec3 normal) {
+    // the yaw that looks along normal, the camera's own for a click
+    float yaw = degrees(atan2(normal.z, normal.x));
+    // portals own GL objects, so they are created on the render thread while this one waits
+    renderThread->call([&] {
         unsigned int framebuffer, portalTexture, rbo;
         generateFrameBufferTexture(rbo, framebuffer, portalTexture);
-        vec3 position = camera.Position + camera.Front;
-        vec3 direction = camera.Front;
         if (noPortalDrawn()) {
             portalIndex = 0;
-            portals[portalIndex] = new Portal(vec3(position.x, 0.50, position.z), camera.Front, nullptr, framebuffer,
-                                              portalTexture,
-                                              portalIndex,
-                                              &camera);
+            portals[portalIndex] = portalPool.create(position, normal, nullptr, framebuffer,
+                                                     portalTexture,
+                                                     portalIndex,
+                                                     yaw);
         } else {
             int nextPortal = (portalIndex + 1) % 2;
-            portals[nextPortal] = new Portal(vec3(position.x, 0.50, position.z), camera.Front, portals[portalIndex],
-                                             framebuffer,
-                                             portalTexture,
-                                             nextPortal,
-                                             &camera);
+            portalPool.destroy(portals[nextPortal]);
+            portals[nextPortal] = portalPool.create(position, normal, portals[portalIndex],
+                                                    framebuffer,
+                                                    portalTexture,
+                                                    nextPortal,
+                                                    yaw);
             portalIndex = nextPortal;
         }
-    }
+    });
 }
 
 
@@ -760,42 +1096,68 @@ void mouse_callback(GLFWwindow *window, double posX, double posY) {
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-unsigned int loadTexture(char const *path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-    return textureID;
-}
-
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
\ No newline at end of file
+    screenWidth = width;
+    screenHeight = height;
+    record([=] { glViewport(0, 0, width, height); });
+}
+
+// records rendering into a portal's target at the governor's resolution
+void bindPortalTarget(unsigned int framebuffer) {
+    int width = portalWidth, height = portalHeight;
+    record([=] {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    });
+}
+
+// records going back to the default framebuffer
+void bindScreen() {
+    int width = screenWidth, height = screenHeight;
+    record([=] {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    });
+}
+
+// Switches to the governor's settings. Portal depth is read while frames are recorded; portal targets and texture
+// bias change on the render thread, before the frame that first uses them.
+void applyQuality(const QualitySettings &settings) {
+    bool resize = settings.portalResolution != quality.portalResolution;
+    quality = settings;
+    portalWidth = std::max(1, (int) (SCR_WIDTH * settings.portalResolution));
+    portalHeight = std::max(1, (int) (SCR_HEIGHT * settings.portalResolution));
+    int width = portalWidth, height = portalHeight;
+    float lodBias = settings.lodBias;
+    record([=] {
+        textureStreamer.setLodBias(lodBias);
+        if (!resize) {
+            return;
+        }
+        // portals placed later are created at this size by generateFrameBufferTexture
+        for (Portal *portal : portals) {
+            if (portal == nullptr) {
+                continue;
+            }
+            glBindTexture(GL_TEXTURE_2D, portal->texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            glBindFramebuffer(GL_FRAMEBUFFER, portal->framebuffer);
+            GLint rbo = 0;
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &rbo);
+            glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+    });
+}
+
+template<typename Command>
+void record(Command command) {
+    renderThread->commands().record(std::move(command));
+}
@@ -6,8 +6,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <frustum.h>
 #include <shader.h>
+#include <texturestreamer.h>
+#include <vertexformat.h>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -29,11 +34,47 @@ struct Vertex {
 };
 
 struct Texture {
-    unsigned int id;
     string type;
     string path;
+    StreamedTexture *stream = nullptr; // array and layer change once the texture has streamed in, read them per draw
 };
 
+// material slots in texture unit order. Each slot samples one sampler2DArray of this name at the layer given by the
+// matching component of the materialLayers uniform.
+const unsigned int MATERIAL_SLOTS = 4;
+const char *const materialSamplerNames[MATERIAL_SLOTS] = {"texture_diffuse", "texture_specular", "texture_normal",
+                                                          "texture_ambient"};
+
+// a level of detail: a range of the mesh's index buffer over the same vertices. error is how far the level strays
+// from the full mesh, relative to the largest extent of the mesh's bounds.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+const unsigned int MAX_MESH_LODS = 4;
+
+// what LOD selection needs to know about the view a mesh is drawn in
+struct LodView {
+    glm::vec3 cameraPosition;
+    float projectionScale; // pixels covered by one unit at distance one
+    unsigned int portalDepth; // 0 for the main view, one more for every portal recursion
+
+    LodView(const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight,
+            unsigned int portalDepth = 0)
+        : cameraPosition(cameraPosition), projectionScale(viewportHeight * 0.5f * projection[1][1]),
+          portalDepth(portalDepth)
+    {
+    }
+};
+
+// a level is used while its error stays below this many pixels on screen
+const float LOD_PIXEL_ERROR = 1.0f;
+// the pixel error allowed grows by this factor per portal recursion, views seen through portals are small and
+// repeated, so they trade detail for cost first
+const float LOD_PORTAL_DEPTH_BIAS = 2.0f;
+
 class Mesh {
 public:
     /*  Mesh Data  */
@@ -41,51 +82,131 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    unsigned int indexCount;
+    glm::vec3 boundsMin, boundsMax;
+    VertexFormat format;
+    vector<MeshLod> lods; // full detail first; a single level covering every index unless LODs were generated
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, takes ownership of the data; pass temporaries or std::move to avoid copying it.
+    // The CPU side copy stays in full floats whatever format the GPU gets.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         VertexFormat format = VERTEX_FULL)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), format(format)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        boundsMin = boundsMax = this->vertices.empty() ? glm::vec3(0.0f) : this->vertices[0].Position;
+        for (const Vertex &vertex : this->vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+        quantisation = vertexQuantisation(boundsMin, boundsMax);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (format == VERTEX_COMPACT)
+        {
+            vector<CompactVertex> compact;
+            compact.reserve(this->vertices.size());
+            for (const Vertex &v : this->vertices)
+                compact.push_back(compactVertex(v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent, quantisation));
+            setupMesh(compact.data(), compact.size(), &this->indices[0], this->indices.size());
+        }
+        else
+            setupMesh(&this->vertices[0], this->vertices.size(), &this->indices[0], this->indices.size());
+        resolveMaterials();
+    }
+
+    // uploads vertex and index data the mesh does not keep a copy of, e.g. straight from a mapped mesh cache
+    Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount,
+         vector<Texture> textures, glm::vec3 boundsMin, glm::vec3 boundsMax)
+        : textures(std::move(textures)), boundsMin(boundsMin), boundsMax(boundsMax), format(VERTEX_FULL)
+    {
+        quantisation = vertexQuantisation(boundsMin, boundsMax);
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+        resolveMaterials();
+    }
+
+    // same for vertices already quantised against boundsMin and boundsMax
+    Mesh(const CompactVertex *vertexData, unsigned int vertexCount, const unsigned int *indexData,
+         unsigned int indexCount, vector<Texture> textures, glm::vec3 boundsMin, glm::vec3 boundsMax)
+        : textures(std::move(textures)), boundsMin(boundsMin), boundsMax(boundsMax), format(VERTEX_COMPACT)
+    {
+        quantisation = vertexQuantisation(boundsMin, boundsMax);
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+        resolveMaterials();
+    }
+
+    // points every material sampler of a program at its slot's texture unit; once per program is enough
+    static void bindMaterialSamplers(Shader &shader)
+    {
+        for (unsigned int slot = 0; slot < MATERIAL_SLOTS; slot++)
+            shader.bindSampler(materialSamplerNames[slot], slot);
+    }
+
+    // a mesh owns GL objects, so it can be moved into a container but never copied
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+
+    // frees the CPU side vertices and indices once they live on the GPU
+    void releaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
     }
 
-    // render the mesh
-    void Draw(Shader shader)
+    // false when the mesh's bounds, drawn with model, lie entirely outside frustum
+    bool visible(const glm::mat4 &model, const Frustum &frustum) const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int ambientNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        glm::vec3 center, extent;
+        transformBounds(boundsMin, boundsMax, model, center, extent);
+        return frustum.intersects(center, extent);
+    }
+
+    // the coarsest level whose error projects to no more than the allowed pixel error for this view
+    unsigned int selectLod(const glm::mat4 &model, const LodView &view) const
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])),
+                               std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 size = (boundsMax - boundsMin) * scale;
+        float extent = std::max(size.x, std::max(size.y, size.z));
+        // distance to the bounding sphere, the camera inside it always gets full detail
+        float distance = glm::length(center - view.cameraPosition) - glm::length(size) * 0.5f;
+        if (distance <= 0.0f)
+            return 0;
+        float tolerance = LOD_PIXEL_ERROR * std::pow(LOD_PORTAL_DEPTH_BIAS, (float) view.portalDepth);
+        unsigned int lod = 0;
+        while (lod + 1 < lods.size() && lods[lod + 1].error * extent * view.projectionScale / distance <= tolerance)
+            lod++;
+        return lod;
+    }
+
+    // render the mesh, lod is clamped to the coarsest level there is
+    void Draw(const Shader &shader, unsigned int lod = 0)
+    {
+        // the arrays stay bound across meshes that share them, only the layer indices change per draw
+        glm::ivec4 layers(0);
+        for (unsigned int slot = 0; slot < MATERIAL_SLOTS; slot++)
+        {
+            if (materials[slot] == nullptr)
+                continue;
+            TextureArrays::bind(slot, materials[slot]->array);
+            layers[slot] = materials[slot]->layer;
+        }
+        shader.setIVec4(Shader::MATERIAL_LAYERS, layers);
+        if (format == VERTEX_COMPACT)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            shader.setVec3(Shader::POSITION_OFFSET, quantisation.offset);
+            shader.setVec3(Shader::POSITION_SCALE, quantisation.scale);
         }
 
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT,
+                       (void*)(level.firstIndex * sizeof(unsigned int)));
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -95,26 +216,29 @@ public:
 private:
     /*  Render data  */
     unsigned int VBO, EBO;
+    VertexQuantisation quantisation;
+    StreamedTexture *materials[MATERIAL_SLOTS]; // first texture of every slot, nullptr when the slot is unused
+
+    // maps textures to slots by type once, instead of building sampler names on every draw. A slot samples only the
+    // first texture of its type.
+    void resolveMaterials()
+    {
+        for (unsigned int slot = 0; slot < MATERIAL_SLOTS; slot++)
+            materials[slot] = nullptr;
+        for (const Texture &texture : textures)
+            for (unsigned int slot = 0; slot < MATERIAL_SLOTS; slot++)
+                if (materials[slot] == nullptr && texture.type == materialSamplerNames[slot])
+                    materials[slot] = texture.stream;
+    }
 
     /*  Functions    */
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        setupBuffers(vertexData, vertexCount * sizeof(Vertex), indexData, indexCount);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -135,5 +259,47 @@ private:
 
         glBindVertexArray(0);
     }
+
+    // same attribute locations, normalised integers and halves expanded by the vertex fetch; location 4 stays unused
+    // because the shader rebuilds the bitangent
+    void setupMesh(const CompactVertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
+    {
+        setupBuffers(vertexData, vertexCount * sizeof(CompactVertex), indexData, indexCount);
+
+        // quantised position and bitangent sign
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+        // octahedral normal
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+        // half float texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+        // octahedral tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, tangent));
+
+        glBindVertexArray(0);
+    }
+
+    // creates the buffers and leaves the vertex array bound for the attribute pointers
+    void setupBuffers(const void *vertexData, size_t vertexBytes, const unsigned int *indexData, size_t indexCount)
+    {
+        this->indexCount = indexCount;
+        lods.assign(1, MeshLod{0, (unsigned int) indexCount, 0.0f});
+
+        // create buffers/arrays
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        // load data into vertex buffers
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+    }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "meshcache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignTo(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t vertexSize(uint32_t format) {
+    return format == VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+// size and modification time of a file, false if it does not exist
+static bool fileStamp(const string &path, uint64_t &size, int64_t &modified) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) {
+        return false;
+    }
+    size = ((uint64_t) info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    modified = (int64_t) (((uint64_t) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = info.st_size;
+    modified = info.st_mtime;
+#endif
+    return true;
+}
+
+bool writeMeshCache(const string &path, const string &sourcePath, const vector<MeshData> &meshes,
+                    const vector<MeshCacheMaterialSource> &materials) {
+    MeshCacheHeader header = {};
+    if (!fileStamp(sourcePath, header.sourceSize, header.sourceModified)) {
+        std::cout << "ERROR::MESH_CACHE::SOURCE_NOT_FOUND " << sourcePath << std::endl;
+        return false;
+    }
+    memcpy(header.magic, "PMSH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.vertexFormat = meshes.empty() ? VERTEX_FULL : meshes[0].format;
+    header.vertexSize = vertexSize(header.vertexFormat);
+    header.optimizations = meshes.empty() ? OPTIMIZE_NONE : meshes[0].optimizations;
+    header.meshCount = meshes.size();
+    header.materialCount = materials.size();
+
+    vector<MeshCacheMesh> records(meshes.size());
+    glm::vec3 modelMin = meshes.empty() ? glm::vec3(0.0f) : meshes[0].boundsMin;
+    glm::vec3 modelMax = meshes.empty() ? glm::vec3(0.0f) : meshes[0].boundsMax;
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        const MeshData &mesh = meshes[i];
+        if (mesh.format != header.vertexFormat) {
+            std::cout << "ERROR::MESH_CACHE::MIXED_VERTEX_FORMATS " << path << std::endl;
+            return false;
+        }
+        MeshCacheMesh &record = records[i];
+        record.firstVertex = header.vertexCount;
+        record.vertexCount = mesh.vertexCount();
+        record.firstIndex = header.indexCount;
+        record.indexCount = mesh.indices.size();
+        record.material = mesh.materialIndex;
+        memcpy(record.boundsMin, &mesh.boundsMin[0], sizeof(record.boundsMin));
+        memcpy(record.boundsMax, &mesh.boundsMax[0], sizeof(record.boundsMax));
+        record.lodCount = std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS);
+        for (unsigned int l = 0; l < record.lodCount; l++) {
+            record.lods[l] = {mesh.lods[l].firstIndex, mesh.lods[l].indexCount, mesh.lods[l].error};
+        }
+        if (record.lodCount == 0) {
+            record.lodCount = 1;
+            record.lods[0] = {0, record.indexCount, 0.0f};
+        }
+        header.vertexCount += mesh.vertexCount();
+        header.indexCount += mesh.indices.size();
+        modelMin = glm::min(modelMin, mesh.boundsMin);
+        modelMax = glm::max(modelMax, mesh.boundsMax);
+    }
+    memcpy(header.boundsMin, &modelMin[0], sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &modelMax[0], sizeof(header.boundsMax));
+
+    vector<MeshCacheMaterial> materialRecords;
+    vector<MeshCacheTexture> textures;
+    for (auto &material : materials) {
+        MeshCacheMaterial record = {(uint32_t) textures.size(), (uint32_t) material.textures.size()};
+        materialRecords.push_back(record);
+        for (auto &texture : material.textures) {
+            MeshCacheTexture entry = {};
+            entry.type = texture.first;
+            if (texture.second.size() >= sizeof(entry.path)) {
+                std::cout << "ERROR::MESH_CACHE::TEXTURE_PATH_TOO_LONG " << texture.second << std::endl;
+                return false;
+            }
+            strcpy(entry.path, texture.second.c_str());
+            textures.push_back(entry);
+        }
+    }
+    header.textureCount = textures.size();
+
+    uint64_t tables = sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheMesh)
+                      + materialRecords.size() * sizeof(MeshCacheMaterial)
+                      + textures.size() * sizeof(MeshCacheTexture);
+    header.vertexDataOffset = alignTo(tables, 16);
+    header.indexDataOffset = alignTo(header.vertexDataOffset + header.vertexCount * header.vertexSize, 16);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::MESH_CACHE::COULD_NOT_WRITE " << path << std::endl;
+        return false;
+    }
+    const char padding[16] = {};
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) records.data(), records.size() * sizeof(MeshCacheMesh));
+    file.write((const char *) materialRecords.data(), materialRecords.size() * sizeof(MeshCacheMaterial));
+    file.write((const char *) textures.data(), textures.size() * sizeof(MeshCacheTexture));
+    file.write(padding, header.vertexDataOffset - tables);
+    for (auto &mesh : meshes) {
+        if (mesh.format == VERTEX_COMPACT) {
+            file.write((const char *) mesh.compactVertices.data(), mesh.compactVertices.size() * sizeof(CompactVertex));
+        } else {
+            file.write((const char *) mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        }
+    }
+    file.write(padding, header.indexDataOffset - (header.vertexDataOffset + header.vertexCount * header.vertexSize));
+    for (auto &mesh : meshes) {
+        file.write((const char *) mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+    }
+    return (bool) file;
+}
+
+#ifdef _WIN32
+MeshCacheFile::MeshCacheFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {
+}
+#else
+MeshCacheFile::MeshCacheFile() : data(nullptr), size(0), fd(-1) {
+}
+#endif
+
+MeshCacheFile::~MeshCacheFile() {
+    close();
+}
+
+bool MeshCacheFile::open(const string &path, const string &sourcePath) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = (size_t) fileSize.QuadPart;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data = mapping != nullptr ? (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    size = info.st_size;
+    void *mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    data = mapped != MAP_FAILED ? (const char *) mapped : nullptr;
+    if (data != nullptr) {
+        madvise(mapped, size, MADV_WILLNEED);
+    }
+#endif
+    if (data == nullptr) {
+        std::cout << "ERROR::MESH_CACHE::COULD_NOT_MAP " << path << std::endl;
+        close();
+        return false;
+    }
+    // validate before anyone follows the offsets
+    const MeshCacheHeader &h = header();
+    bool valid = size >= sizeof(MeshCacheHeader) && memcmp(h.magic, "PMSH", 4) == 0
+                 && h.version == MESH_CACHE_VERSION && h.vertexFormat <= VERTEX_COMPACT
+                 && h.vertexSize == vertexSize(h.vertexFormat)
+                 && h.vertexDataOffset + h.vertexCount * h.vertexSize <= size
+                 && h.indexDataOffset + h.indexCount * sizeof(unsigned int) <= size
+                 && sizeof(MeshCacheHeader) + h.meshCount * sizeof(MeshCacheMesh)
+                    + h.materialCount * sizeof(MeshCacheMaterial)
+                    + h.textureCount * sizeof(MeshCacheTexture) <= h.vertexDataOffset;
+    for (uint32_t i = 0; valid && i < h.meshCount; i++) {
+        const MeshCacheMesh &mesh = meshes()[i];
+        valid = (uint64_t) mesh.firstVertex + mesh.vertexCount <= h.vertexCount
+                && (uint64_t) mesh.firstIndex + mesh.indexCount <= h.indexCount
+                && mesh.material < h.materialCount && mesh.lodCount >= 1 && mesh.lodCount <= MAX_MESH_LODS;
+        for (uint32_t l = 0; valid && l < mesh.lodCount; l++) {
+            valid = (uint64_t) mesh.lods[l].firstIndex + mesh.lods[l].indexCount <= mesh.indexCount;
+        }
+        // indices are relative to the mesh's vertices and go to the GPU unchecked
+        const unsigned int *index = valid ? indices(mesh) : nullptr;
+        for (uint32_t j = 0; valid && j < mesh.indexCount; j++) {
+            valid = index[j] < mesh.vertexCount;
+        }
+    }
+    for (uint32_t i = 0; valid && i < h.materialCount; i++) {
+        valid = (uint64_t) materials()[i].firstTexture + materials()[i].textureCount <= h.textureCount;
+    }
+    // texture paths are used as C strings
+    for (uint32_t i = 0; valid && i < h.textureCount; i++) {
+        valid = textures()[i].type < MATERIAL_TEXTURE_TYPES
+                && memchr(textures()[i].path, '\0', sizeof(textures()[i].path)) != nullptr;
+    }
+    if (!valid) {
+        std::cout << "ERROR::MESH_CACHE::INVALID_OR_OUTDATED " << path << std::endl;
+        close();
+        return false;
+    }
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!sourcePath.empty() && fileStamp(sourcePath, sourceSize, sourceModified)
+        && (sourceSize != h.sourceSize || sourceModified != h.sourceModified)) {
+        std::cout << "ERROR::MESH_CACHE::STALE " << path << " is older than " << sourcePath << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshCacheFile::close() {
+#ifdef _WIN32
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data != nullptr) {
+        munmap((void *) data, size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
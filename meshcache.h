@@ -0,0 +1,142 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <meshdata.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Preprocessed binary mesh format. Everything Model needs is stored the way it is uploaded:
+ *
+ *   MeshCacheHeader
+ *   MeshCacheMesh[meshCount]
+ *   MeshCacheMaterial[materialCount]
+ *   MeshCacheTexture[textureCount]
+ *   Vertex[vertexCount]            at vertexDataOffset, interleaved exactly like mesh.h's Vertex, or
+ *   CompactVertex[vertexCount]     when vertexFormat is VERTEX_COMPACT, quantised against each mesh's bounds
+ *   uint32 index[indexCount]       at indexDataOffset, every mesh's levels of detail back to back
+ *
+ * Files are written by tools/meshbake from anything Assimp reads and mapped into memory by MeshCacheFile. Indices and
+ * vertices are stored after the import time reordering passes (see meshoptimize.h), so loading never repeats them.
+ * The size and modification time of the model a file was baked from are kept, so editing the model invalidates it.
+ */
+const char *const MESH_CACHE_EXTENSION = ".pmesh";
+const uint32_t MESH_CACHE_VERSION = 4;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t vertexFormat; // VertexFormat
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t textureCount;
+    uint32_t optimizations; // MeshOptimization passes the data went through while baking
+    uint64_t vertexDataOffset;
+    uint64_t vertexCount;
+    uint64_t indexDataOffset;
+    uint64_t indexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint64_t sourceSize; // of the baked model file
+    int64_t sourceModified; // its modification time, in the platform's file time units
+};
+
+struct MeshCacheLod {
+    uint32_t firstIndex; // relative to the mesh's firstIndex
+    uint32_t indexCount;
+    float error;
+};
+
+struct MeshCacheMesh {
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount; // of all levels
+    uint32_t material;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t lodCount;
+    MeshCacheLod lods[MAX_MESH_LODS];
+};
+
+struct MeshCacheMaterial {
+    uint32_t firstTexture;
+    uint32_t textureCount;
+};
+
+struct MeshCacheTexture {
+    uint32_t type; // index into materialTextureNames
+    char path[252]; // NUL terminated
+};
+
+// texture paths per material, grouped by materialTextureTypes index
+struct MeshCacheMaterialSource {
+    vector<pair<uint32_t, string> > textures;
+};
+
+// the vertex format is taken from the meshes, which all have to share it. sourcePath is the model they came from.
+bool writeMeshCache(const string &path, const string &sourcePath, const vector<MeshData> &meshes,
+                    const vector<MeshCacheMaterialSource> &materials);
+
+/**
+ * Read only memory mapping of a mesh cache file. The accessors point straight into the mapping,
+ * so vertex and index data can be handed to glBufferData without any parsing or copying.
+ */
+class MeshCacheFile {
+public:
+    MeshCacheFile();
+
+    ~MeshCacheFile();
+
+    MeshCacheFile(const MeshCacheFile &) = delete;
+
+    MeshCacheFile &operator=(const MeshCacheFile &) = delete;
+
+    // maps and validates the file, prints the reason and returns false if it cannot be used. With a sourcePath that
+    // exists, the file also has to have been baked from that model as it is now.
+    bool open(const string &path, const string &sourcePath = "");
+
+    void close();
+
+    const MeshCacheHeader &header() const { return *(const MeshCacheHeader *) data; }
+
+    const MeshCacheMesh *meshes() const { return (const MeshCacheMesh *) (data + sizeof(MeshCacheHeader)); }
+
+    const MeshCacheMaterial *materials() const {
+        return (const MeshCacheMaterial *) (meshes() + header().meshCount);
+    }
+
+    const MeshCacheTexture *textures() const {
+        return (const MeshCacheTexture *) (materials() + header().materialCount);
+    }
+
+    VertexFormat vertexFormat() const { return (VertexFormat) header().vertexFormat; }
+
+    // only valid for VERTEX_FULL files
+    const Vertex *vertices(const MeshCacheMesh &mesh) const {
+        return (const Vertex *) (data + header().vertexDataOffset) + mesh.firstVertex;
+    }
+
+    // only valid for VERTEX_COMPACT files
+    const CompactVertex *compactVertices(const MeshCacheMesh &mesh) const {
+        return (const CompactVertex *) (data + header().vertexDataOffset) + mesh.firstVertex;
+    }
+
+    const unsigned int *indices(const MeshCacheMesh &mesh) const {
+        return (const unsigned int *) (data + header().indexDataOffset) + mesh.firstIndex;
+    }
+
+private:
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    void *file, *mapping;
+#else
+    int fd;
+#endif
+};
+
+#endif //MESHCACHE_H
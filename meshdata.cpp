@@ -0,0 +1,165 @@
+#include "meshdata.h"
+
+#include <jobsystem.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+MeshData convertMesh(const aiMesh *mesh, VertexFormat format, unsigned int optimizations) {
+    MeshData data;
+    data.materialIndex = mesh->mMaterialIndex;
+    data.vertices.resize(mesh->mNumVertices);
+    data.boundsMin = glm::vec3(mesh->mNumVertices > 0 ? mesh->mVertices[0].x : 0.0f,
+                               mesh->mNumVertices > 0 ? mesh->mVertices[0].y : 0.0f,
+                               mesh->mNumVertices > 0 ? mesh->mVertices[0].z : 0.0f);
+    data.boundsMax = data.boundsMin;
+    bool hasNormals = mesh->mNormals != nullptr;
+    bool hasTangents = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
+    // Walk through each of the mesh's vertices
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex &vertex = data.vertices[i];
+        vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        data.boundsMin = glm::min(data.boundsMin, vertex.Position);
+        data.boundsMax = glm::max(data.boundsMax, vertex.Position);
+        vertex.Normal = hasNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z)
+                                   : glm::vec3(0.0f);
+        // a vertex can contain up to 8 different texture coordinates, we always take the first set (0).
+        if (mesh->mTextureCoords[0]) {
+            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+        } else {
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        }
+        if (hasTangents) {
+            vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+            vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+        } else {
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        }
+    }
+    // retrieve the corresponding vertex indices. aiProcess_Triangulate leaves point and line faces alone, those are
+    // skipped so indices stays a triangle list.
+    data.indices.reserve(mesh->mNumFaces * 3);
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace &face = mesh->mFaces[i];
+        if (face.mNumIndices == 3) {
+            data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + 3);
+        }
+    }
+    optimizeMeshData(data, optimizations);
+    data.lods.assign(1, MeshLod{0, (unsigned int) data.indices.size(), 0.0f});
+    if (optimizations & OPTIMIZE_LOD_CHAIN) {
+        generateMeshLods(data);
+    }
+    if (format == VERTEX_COMPACT) {
+        compactMeshData(data);
+    }
+    return data;
+}
+
+void optimizeMeshData(MeshData &data, unsigned int optimizations) {
+    data.acmrBefore = vertexCacheAcmr(data.indices, data.vertices.size());
+    if (optimizations & OPTIMIZE_VERTEX_CACHE) {
+        optimizeVertexCache(data.indices, data.vertices.size());
+    }
+    if ((optimizations & OPTIMIZE_OVERDRAW) && !data.vertices.empty()) {
+        optimizeOverdraw(data.indices, &data.vertices[0].Position.x, sizeof(Vertex), data.vertices.size());
+    }
+    if (optimizations & OPTIMIZE_VERTEX_FETCH) {
+        vector<unsigned int> remap;
+        vector<Vertex> vertices(optimizeVertexFetchRemap(data.indices, data.vertices.size(), remap));
+        for (size_t v = 0; v < remap.size(); v++) {
+            if (remap[v] != ~0u) {
+                vertices[remap[v]] = data.vertices[v];
+            }
+        }
+        for (unsigned int &index : data.indices) {
+            index = remap[index];
+        }
+        data.vertices.swap(vertices);
+    }
+    data.acmrAfter = vertexCacheAcmr(data.indices, data.vertices.size());
+    data.optimizations = optimizations;
+}
+
+void generateMeshLods(MeshData &data) {
+    if (data.vertices.empty()) {
+        return;
+    }
+    vector<unsigned int> source(data.indices.begin(), data.indices.begin() + data.lods.back().indexCount), level;
+    float error = 0.0f;
+    while (data.lods.size() < MAX_MESH_LODS) {
+        size_t target = source.size() / 2 / 3 * 3;
+        // each level starts from the previous one, so the error accumulates along the chain
+        error += simplifyMesh(source, &data.vertices[0].Position.x, sizeof(Vertex), data.vertices.size(), target,
+                              LOD_MAX_ERROR - error, level);
+        if (level.empty() || level.size() > source.size() * 3 / 4) {
+            break;
+        }
+        optimizeVertexCache(level, data.vertices.size());
+        data.lods.push_back(MeshLod{(unsigned int) data.indices.size(), (unsigned int) level.size(), error});
+        data.indices.insert(data.indices.end(), level.begin(), level.end());
+        source.swap(level);
+    }
+}
+
+void compactMeshData(MeshData &data) {
+    VertexQuantisation quantisation = vertexQuantisation(data.boundsMin, data.boundsMax);
+    data.compactVertices.resize(data.vertices.size());
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        const Vertex &v = data.vertices[i];
+        data.compactVertices[i] = compactVertex(v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent,
+                                                quantisation);
+    }
+    vector<Vertex>().swap(data.vertices);
+    data.format = VERTEX_COMPACT;
+}
+
+void convertMeshes(const vector<const aiMesh *> &meshes, const std::function<void(unsigned int, MeshData &)> &consume,
+                   VertexFormat format, unsigned int optimizations) {
+    vector<MeshData> results(meshes.size());
+    vector<char> done(meshes.size(), 0);
+    std::mutex mutex;
+    std::condition_variable converted;
+    JobSystem &jobs = JobSystem::shared();
+    JobCounter counter;
+
+    // one job per mesh, so one large mesh does not hold up a whole batch
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        jobs.run([&, i]() {
+            MeshData data = convertMesh(meshes[i], format, optimizations);
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i] = std::move(data);
+            done[i] = 1;
+            converted.notify_one();
+        }, &counter, "convertMesh");
+    }
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        MeshData data;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!done[i]) {
+                // convert a mesh here rather than idle, unless everything left is already being converted
+                lock.unlock();
+                bool helped = jobs.help();
+                lock.lock();
+                if (!helped) {
+                    converted.wait(lock, [&]() { return done[i] != 0; });
+                }
+            }
+            data = std::move(results[i]);
+        }
+        consume(i, data);
+    }
+    jobs.wait(counter);
+}
+
+void collectMeshes(const aiNode *node, const aiScene *scene, vector<const aiMesh *> &meshes) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        collectMeshes(node->mChildren[i], scene, meshes);
+    }
+}
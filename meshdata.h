@@ -0,0 +1,69 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <mesh.h>
+#include <meshoptimize.h>
+#include <meshsimplify.h>
+
+#include <assimp/scene.h>
+
+#include <functional>
+#include <vector>
+
+// the material texture types we load, in Mesh's material slot order
+const unsigned int MATERIAL_TEXTURE_TYPES = MATERIAL_SLOTS;
+const aiTextureType materialTextureTypes[MATERIAL_TEXTURE_TYPES] = {aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+                                                                     aiTextureType_HEIGHT, aiTextureType_AMBIENT};
+const char *const *const materialTextureNames = materialSamplerNames;
+
+/**
+ * CPU side result of converting one Assimp mesh: interleaved vertices, flattened triangle indices and bounds.
+ * Free of GL calls, so it is shared by Model and the offline mesh baker.
+ * Depending on format either vertices or compactVertices is filled, the compact ones quantised against the bounds.
+ * indices holds every level of detail back to back, lods says where each one starts.
+ */
+struct MeshData {
+    VertexFormat format = VERTEX_FULL;
+    vector<Vertex> vertices;
+    vector<CompactVertex> compactVertices;
+    vector<unsigned int> indices;
+    vector<MeshLod> lods;
+    unsigned int materialIndex = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    unsigned int optimizations = OPTIMIZE_NONE; // MeshOptimization passes applied
+    // post-transform cache misses per triangle as imported and after optimizeMeshData
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+
+    size_t vertexCount() const { return format == VERTEX_COMPACT ? compactVertices.size() : vertices.size(); }
+
+    // at full detail
+    size_t triangleCount() const { return (lods.empty() ? indices.size() : lods[0].indexCount) / 3; }
+};
+
+MeshData convertMesh(const aiMesh *mesh, VertexFormat format = VERTEX_FULL,
+                     unsigned int optimizations = OPTIMIZE_DEFAULT);
+
+// reorders the full vertices and the indices with the given MeshOptimization passes and records the ACMR
+void optimizeMeshData(MeshData &data, unsigned int optimizations);
+
+// appends up to MAX_MESH_LODS - 1 levels, each simplified to half of the one before, while that still removes a
+// noticeable share of triangles and the error stays below LOD_MAX_ERROR
+void generateMeshLods(MeshData &data);
+
+// largest error of a generated level, relative to the mesh extent
+const float LOD_MAX_ERROR = 0.05f;
+
+// quantises the full vertices into compactVertices and frees them
+void compactMeshData(MeshData &data);
+
+// converts meshes as parallel jobs on the shared JobSystem. consume is called on the calling thread (the GL thread) for every
+// mesh, in order, as soon as its conversion is done, so uploads overlap with the conversion of later meshes.
+void convertMeshes(const vector<const aiMesh *> &meshes, const std::function<void(unsigned int, MeshData &)> &consume,
+                   VertexFormat format = VERTEX_FULL, unsigned int optimizations = OPTIMIZE_DEFAULT);
+
+// appends the meshes referenced by node and its children, in the order Model has always processed them
+void collectMeshes(const aiNode *node, const aiScene *scene, vector<const aiMesh *> &meshes);
+
+#endif //MESHDATA_H
@@ -0,0 +1,231 @@
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+static const unsigned int FIFO_CACHE_SIZE = 16;
+static const int SCORE_CACHE_SIZE = 32;
+
+float vertexCacheAcmr(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize) {
+    if (indices.size() < 3) {
+        return 0.0f;
+    }
+    // a vertex is cached while fewer than cacheSize other vertices were inserted after it
+    vector<size_t> inserted(vertexCount, 0);
+    size_t time = cacheSize + 1, misses = 0;
+    for (unsigned int index : indices) {
+        if (time - inserted[index] > cacheSize) {
+            inserted[index] = time++;
+            misses++;
+        }
+    }
+    return (float) misses / (indices.size() / 3);
+}
+
+// Forsyth's scoring: the last triangle's vertices score a flat 0.75, older cache entries fall off with their
+// position, and vertices with few triangles left get a boost so they are finished off instead of left dangling
+static float vertexScore(int cachePosition, unsigned int remaining) {
+    if (remaining == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 3) {
+        score = std::pow(1.0f - (cachePosition - 3) / (float) (SCORE_CACHE_SIZE - 3), 1.5f);
+    } else if (cachePosition >= 0) {
+        score = 0.75f;
+    }
+    return score + 2.0f / std::sqrt((float) remaining);
+}
+
+void optimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || indices.size() % 3 != 0) {
+        return;
+    }
+    // triangles of every vertex; the first remaining[v] entries of its range are the ones not emitted yet
+    vector<unsigned int> remaining(vertexCount, 0), first(vertexCount + 1, 0);
+    for (unsigned int index : indices) {
+        remaining[index]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        first[v + 1] = first[v] + remaining[v];
+    }
+    vector<unsigned int> adjacency(indices.size()), fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    vector<float> triangleScore(triangleCount);
+    vector<char> emitted(triangleCount, 0);
+    size_t best = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+        if (triangleScore[t] > triangleScore[best]) {
+            best = t;
+        }
+    }
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    vector<unsigned int> cache, next;
+    size_t scan = 0;
+    while (true) {
+        const unsigned int *triangle = &indices[best * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[best] = 1;
+        if (result.size() == indices.size()) {
+            break;
+        }
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            unsigned int *live = &adjacency[first[v]];
+            unsigned int *found = std::find(live, live + remaining[v], (unsigned int) best);
+            std::swap(*found, live[remaining[v] - 1]);
+            remaining[v]--;
+        }
+
+        // the new triangle's vertices move to the front, everything else shifts back and the tail falls out
+        next.assign(triangle, triangle + 3);
+        for (unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                next.push_back(v);
+            }
+        }
+        for (size_t i = 0; i < next.size(); i++) {
+            unsigned int v = next[i];
+            cachePosition[v] = i < (size_t) SCORE_CACHE_SIZE ? (int) i : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        // only triangles touching the cache changed score, the best of them is emitted next
+        float bestScore = -1.0f;
+        for (unsigned int v : next) {
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                unsigned int t = adjacency[first[v] + i];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (next.size() > (size_t) SCORE_CACHE_SIZE) {
+            next.resize(SCORE_CACHE_SIZE);
+        }
+        cache.swap(next);
+
+        // nothing in the cache has triangles left, continue with the next untouched one in input order
+        if (bestScore < 0.0f) {
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = scan;
+        }
+    }
+    indices.swap(result);
+}
+
+namespace {
+struct Cluster {
+    size_t firstTriangle, triangleCount;
+    float sortKey;
+};
+}
+
+void optimizeOverdraw(vector<unsigned int> &indices, const float *positions, size_t stride, size_t vertexCount,
+                      float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || indices.size() % 3 != 0) {
+        return;
+    }
+    auto position = [&](unsigned int v) { return (const float *) ((const char *) positions + v * stride); };
+
+    // A triangle missing all of its vertices restarts the cache, so a cluster can start there for free. A triangle
+    // with two misses loses at most one hit when its cluster moves, those boundaries are taken while the misses
+    // they can add stay within threshold.
+    float budget = (threshold - 1.0f) * vertexCacheAcmr(indices, vertexCount, FIFO_CACHE_SIZE) * triangleCount;
+    vector<Cluster> clusters;
+    vector<size_t> inserted(vertexCount, 0);
+    size_t time = FIFO_CACHE_SIZE + 1;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            if (time - inserted[v] > FIFO_CACHE_SIZE) {
+                inserted[v] = time++;
+                misses++;
+            }
+        }
+        bool soft = misses == 2 && budget >= 1.0f;
+        if (t == 0 || misses == 3 || soft) {
+            budget -= soft && t > 0 ? 1.0f : 0.0f;
+            clusters.push_back({t, 0, 0.0f});
+        }
+        clusters.back().triangleCount++;
+    }
+
+    // area weighted centroid and normal of every cluster; clusters facing away from the mesh centre sort first,
+    // since they tend to cover the rest of the mesh
+    vector<float> centroids(clusters.size() * 3, 0.0f), normals(clusters.size() * 3, 0.0f);
+    float meshCentroid[3] = {0.0f, 0.0f, 0.0f}, meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        float area = 0.0f;
+        for (size_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; t++) {
+            const float *a = position(indices[t * 3]), *b = position(indices[t * 3 + 1]), *p = position(indices[t * 3 + 2]);
+            float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float e2[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int axis = 0; axis < 3; axis++) {
+                centroids[c * 3 + axis] += (a[axis] + b[axis] + p[axis]) / 3.0f * triangleArea;
+                normals[c * 3 + axis] += n[axis];
+            }
+            area += triangleArea;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            meshCentroid[axis] += centroids[c * 3 + axis];
+            centroids[c * 3 + axis] /= area > 0.0f ? area : 1.0f;
+        }
+        meshArea += area;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        meshCentroid[axis] /= meshArea > 0.0f ? meshArea : 1.0f;
+    }
+    for (size_t c = 0; c < clusters.size(); c++) {
+        const float *n = &normals[c * 3];
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float key = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            key += (centroids[c * 3 + axis] - meshCentroid[axis]) * n[axis];
+        }
+        clusters[c].sortKey = length > 0.0f ? key / length : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster &cluster : clusters) {
+        result.insert(result.end(), indices.begin() + cluster.firstTriangle * 3,
+                      indices.begin() + (cluster.firstTriangle + cluster.triangleCount) * 3);
+    }
+    indices.swap(result);
+}
+
+size_t optimizeVertexFetchRemap(const vector<unsigned int> &indices, size_t vertexCount, vector<unsigned int> &remap) {
+    remap.assign(vertexCount, ~0u);
+    unsigned int next = 0;
+    for (unsigned int index : indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = next++;
+        }
+    }
+    return next;
+}
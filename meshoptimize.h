@@ -0,0 +1,34 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <cstddef>
+#include <vector>
+
+// import time passes, applied in this order by optimizeMeshData and generateMeshLods (see meshdata.h)
+enum MeshOptimization : unsigned int {
+    OPTIMIZE_NONE = 0,
+    OPTIMIZE_VERTEX_CACHE = 1 << 0, // triangle order for post-transform cache hits
+    OPTIMIZE_OVERDRAW = 1 << 1,     // cluster order for early depth rejection, gives back a little of the cache gain
+    OPTIMIZE_VERTEX_FETCH = 1 << 2, // vertex order for memory locality, drops unreferenced vertices
+    OPTIMIZE_LOD_CHAIN = 1 << 3,    // simplified levels of detail appended to the index buffer, see meshsimplify.h
+    OPTIMIZE_DEFAULT = OPTIMIZE_VERTEX_CACHE | OPTIMIZE_VERTEX_FETCH | OPTIMIZE_LOD_CHAIN
+};
+
+// average cache misses per triangle of a FIFO post-transform cache: 3 is no reuse at all, ~0.5 is ideal for a grid
+float vertexCacheAcmr(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// reorders triangles with Forsyth's linear-speed vertex cache optimisation. Like the passes below it expects a
+// triangle list and leaves anything else untouched.
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// splits cache optimised triangles into clusters at points where the cache restarts anyway and sorts the clusters so
+// outward facing ones are drawn first. threshold is how much the ACMR may grow, 1.05 allows 5%. positions are 3
+// floats at every stride bytes.
+void optimizeOverdraw(std::vector<unsigned int> &indices, const float *positions, size_t stride, size_t vertexCount,
+                      float threshold = 1.05f);
+
+// new index of every vertex in order of first use, unreferenced vertices map to ~0u. Returns the vertex count kept.
+size_t optimizeVertexFetchRemap(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                std::vector<unsigned int> &remap);
+
+#endif //MESHOPTIMIZE_H
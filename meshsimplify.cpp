@@ -0,0 +1,249 @@
+#include "meshsimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using std::vector;
+
+namespace {
+// symmetric 4x4 matrix summing the weighted squared distances to a set of planes
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+    double weight = 0;
+
+    void addPlane(const double n[3], double d, double weight) {
+        a00 += weight * n[0] * n[0];
+        a01 += weight * n[0] * n[1];
+        a02 += weight * n[0] * n[2];
+        a03 += weight * n[0] * d;
+        a11 += weight * n[1] * n[1];
+        a12 += weight * n[1] * n[2];
+        a13 += weight * n[1] * d;
+        a22 += weight * n[2] * n[2];
+        a23 += weight * n[2] * d;
+        a33 += weight * d * d;
+        this->weight += weight;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03, a11 += q.a11;
+        a12 += q.a12, a13 += q.a13, a22 += q.a22, a23 += q.a23, a33 += q.a33;
+        weight += q.weight;
+    }
+
+    // mean squared distance, so the result does not depend on how much area the planes cover
+    double error(const double p[3]) const {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+        double x = p[0], y = p[1], z = p[2];
+        return (a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x + a11 * y * y + 2 * a12 * y * z
+               + 2 * a13 * y + a22 * z * z + 2 * a23 * z + a33) / weight;
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+}
+
+static void cross(const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void triangleNormal(const double *p0, const double *p1, const double *p2, double out[3]) {
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(e1, e2, out);
+}
+
+static uint64_t edgeKey(unsigned int a, unsigned int b) {
+    return a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+}
+
+float simplifyMesh(const vector<unsigned int> &indices, const float *positions, size_t stride, size_t vertexCount,
+                   size_t targetIndexCount, float targetError, vector<unsigned int> &result) {
+    result = indices;
+    if (indices.size() <= targetIndexCount || vertexCount == 0 || indices.size() % 3 != 0) {
+        return 0.0f;
+    }
+
+    // positions scaled into a unit box, so quadric errors come out relative to the mesh extent
+    vector<double> points(vertexCount * 3);
+    double minimum[3] = {HUGE_VAL, HUGE_VAL, HUGE_VAL}, extent = 0.0;
+    for (unsigned int index : indices) {
+        const float *p = (const float *) ((const char *) positions + index * stride);
+        for (int axis = 0; axis < 3; axis++) {
+            minimum[axis] = std::min(minimum[axis], (double) p[axis]);
+        }
+    }
+    for (unsigned int index : indices) {
+        const float *p = (const float *) ((const char *) positions + index * stride);
+        for (int axis = 0; axis < 3; axis++) {
+            extent = std::max(extent, p[axis] - minimum[axis]);
+        }
+    }
+    double scale = extent > 0.0 ? 1.0 / extent : 1.0;
+    for (size_t v = 0; v < vertexCount; v++) {
+        const float *p = (const float *) ((const char *) positions + v * stride);
+        for (int axis = 0; axis < 3; axis++) {
+            points[v * 3 + axis] = (p[axis] - minimum[axis]) * scale;
+        }
+    }
+    auto point = [&](unsigned int v) { return &points[v * 3]; };
+
+    // every vertex starts with the planes of its triangles, weighted by area
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        double n[3];
+        triangleNormal(point(indices[t]), point(indices[t + 1]), point(indices[t + 2]), n);
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) {
+            continue;
+        }
+        n[0] /= length, n[1] /= length, n[2] /= length;
+        const double *p = point(indices[t]);
+        double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (int k = 0; k < 3; k++) {
+            quadrics[indices[t + k]].addPlane(n, d, length * 0.5);
+        }
+    }
+
+    // edges not shared by exactly two triangles are borders, seams or non-manifold; their vertices stay put
+    vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+            edges.push_back(edgeKey(indices[t + k], indices[t + (k + 1) % 3]));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    vector<char> locked(vertexCount, 0);
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) {
+            j++;
+        }
+        if (j - i != 2) {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & 0xffffffffu] = 1;
+        }
+        i = j;
+    }
+
+    float reached = 0.0f;
+    vector<unsigned int> remap(vertexCount), adjacency, first(vertexCount + 1), fill;
+    vector<char> touched(vertexCount);
+    vector<Collapse> candidates;
+    // each pass collapses the cheapest independent edges, then rebuilds the triangles and tries again
+    while (result.size() > targetIndexCount) {
+        edges.clear();
+        for (size_t t = 0; t < result.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                edges.push_back(edgeKey(result[t + k], result[t + (k + 1) % 3]));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        candidates.clear();
+        for (uint64_t edge : edges) {
+            unsigned int a = edge >> 32, b = edge & 0xffffffffu;
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            double ontoB = locked[a] ? HUGE_VAL : q.error(point(b));
+            double ontoA = locked[b] ? HUGE_VAL : q.error(point(a));
+            if (ontoB == HUGE_VAL && ontoA == HUGE_VAL) {
+                continue;
+            }
+            candidates.push_back(ontoB <= ontoA ? Collapse{a, b, ontoB} : Collapse{b, a, ontoA});
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+        // triangles around every vertex, for the flip test and the one ring
+        std::fill(first.begin(), first.end(), 0);
+        for (unsigned int index : result) {
+            first[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            first[v + 1] += first[v];
+        }
+        adjacency.resize(result.size());
+        fill.assign(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) {
+            adjacency[fill[result[i]]++] = i / 3;
+        }
+
+        for (size_t v = 0; v < vertexCount; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t indexCount = result.size();
+        unsigned int collapses = 0;
+        for (const Collapse &collapse : candidates) {
+            if (indexCount <= targetIndexCount) {
+                break;
+            }
+            float error = (float) std::sqrt(std::max(collapse.cost, 0.0));
+            if (error > targetError) {
+                break;
+            }
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to]) {
+                continue;
+            }
+            // moving from onto to must not turn any surviving triangle around
+            bool flips = false;
+            unsigned int removed = 0;
+            for (unsigned int i = first[from]; i < first[from + 1] && !flips; i++) {
+                const unsigned int *triangle = &result[adjacency[i] * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                    removed++;
+                    continue;
+                }
+                const double *p[3], *q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = point(triangle[k]);
+                    q[k] = triangle[k] == from ? point(to) : p[k];
+                }
+                double before[3], after[3];
+                triangleNormal(p[0], p[1], p[2], before);
+                triangleNormal(q[0], q[1], q[2], after);
+                flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0;
+            }
+            if (flips) {
+                continue;
+            }
+            remap[from] = to;
+            quadrics[to].add(quadrics[from]);
+            // the one ring of from changes shape, so none of it collapses again in this pass
+            for (unsigned int i = first[from]; i < first[from + 1]; i++) {
+                for (int k = 0; k < 3; k++) {
+                    touched[result[adjacency[i] * 3 + k]] = 1;
+                }
+            }
+            indexCount -= removed * 3;
+            reached = std::max(reached, error);
+            collapses++;
+        }
+        if (collapses == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < result.size(); t += 3) {
+            unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (a != b && b != c && a != c) {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+        result.resize(write);
+    }
+    return reached;
+}
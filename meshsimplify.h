@@ -0,0 +1,19 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Quadric error edge collapse (Garland and Heckbert) over an index buffer. Vertices collapse onto one of their
+ * neighbours instead of a new position, so every simplified level indexes the source vertex buffer and LODs only cost
+ * extra indices. Vertices on open borders and attribute seams are locked, collapses that flip a triangle are skipped.
+ *
+ * Collapses stop once result holds at most targetIndexCount indices, or when the next one would move the surface by
+ * more than targetError, given relative to the largest extent of the mesh. Returns the error reached, relative as well.
+ * positions are 3 floats at every stride bytes.
+ */
+float simplifyMesh(const std::vector<unsigned int> &indices, const float *positions, size_t stride, size_t vertexCount,
+                   size_t targetIndexCount, float targetError, std::vector<unsigned int> &result);
+
+#endif //MESHSIMPLIFY_H
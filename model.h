@@ -5,14 +5,15 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include <mesh.h>
+#include <meshcache.h>
+#include <meshdata.h>
 #include <shader.h>
+#include <texturecache.h>
 
 #include <string>
 #include <fstream>
@@ -22,31 +23,92 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+StreamedTexture *TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
 class Model
 {
 public:
     /*  Model Data */
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<StreamedTexture *> textures_loaded;	// references held on the shared texture cache, released with the model
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    bool keepVertexData;
+    glm::vec3 boundsMin, boundsMax; // around every mesh, filled once loading finishes
+    VertexFormat vertexFormat;
+    unsigned int optimizations;
 
     /*  Functions   */
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. A baked mesh cache (see tools/meshbake) is used instead of
+    // importing through Assimp when the path names one, or when one exists next to the model file.
+    // Unless keepVertexData is set, each mesh's CPU side data is dropped as soon as it is uploaded.
+    // VERTEX_COMPACT uploads quantised vertices, draw those with the COMPACT_VERTEX variant of shaders/mesh.vert. A
+    // baked cache keeps the format it was baked with (meshbake --compact).
+    // optimizations are the MeshOptimization passes run on import; a baked cache already went through them.
+    Model(string const &path, bool gamma = false, bool keepVertexData = false, VertexFormat vertexFormat = VERTEX_FULL,
+          unsigned int optimizations = OPTIMIZE_DEFAULT)
+        : gammaCorrection(gamma), keepVertexData(keepVertexData), vertexFormat(vertexFormat),
+          optimizations(optimizations)
     {
-        loadModel(path);
+        bool cacheNamed = endsWith(path, MESH_CACHE_EXTENSION);
+        if (!loadCache(cacheNamed ? path : path + MESH_CACHE_EXTENSION, cacheNamed ? "" : path))
+            loadModel(path);
+        boundsMin = boundsMax = meshes.empty() ? glm::vec3(0.0f) : meshes[0].boundsMin;
+        for (const Mesh &mesh : meshes)
+        {
+            boundsMin = glm::min(boundsMin, mesh.boundsMin);
+            boundsMax = glm::max(boundsMax, mesh.boundsMax);
+        }
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+    Model(Model &&) = default;
+    Model &operator=(Model &&) = default;
+
+    ~Model()
+    {
+        for (StreamedTexture *texture : textures_loaded)
+            TextureCache::shared().release(texture);
+    }
+
+    // draws the model, and thus all its meshes. The program needs Mesh::bindMaterialSamplers() called on it once.
+    void Draw(const Shader &shader)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // same, with every mesh at the level of detail its size in this view calls for; model is the matrix it is drawn
+    // with. Portal views pass their recursion depth in view, so deeper views fall back to coarser levels sooner.
+    // With a frustum, the model's bounds and then every mesh's are tested first; stats counts the meshes.
+    void Draw(const Shader &shader, const glm::mat4 &model, const LodView &view, const Frustum *frustum = nullptr,
+              CullStats *stats = nullptr)
+    {
+        if (stats != nullptr)
+            stats->tested += meshes.size();
+        if (frustum != nullptr && !visible(model, *frustum))
+            return;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (frustum != nullptr && !meshes[i].visible(model, *frustum))
+                continue;
+            meshes[i].Draw(shader, meshes[i].selectLod(model, view));
+            if (stats != nullptr)
+                stats->visible++;
+        }
+    }
+
+    // the box around every mesh, in model space
+    bool visible(const glm::mat4 &model, const Frustum &frustum) const
+    {
+        if (meshes.empty())
+            return false;
+        glm::vec3 center, extent;
+        transformBounds(boundsMin, boundsMax, model, center, extent);
+        return frustum.intersects(center, extent);
+    }
+
 private:
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
@@ -64,181 +126,136 @@ private:
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // gather the meshes of ASSIMP's node hierarchy first, so meshes is allocated exactly once
+        vector<const aiMesh *> sources;
+        collectMeshes(scene->mRootNode, scene, sources);
+        meshes.reserve(sources.size());
+        // vertex packing, quantisation, index flattening and bounds run on worker threads, GL uploads stay on this
+        // thread. Kept vertices stay in full floats and are quantised by Mesh.
+        double missesBefore = 0.0, missesAfter = 0.0;
+        size_t triangles = 0;
+        convertMeshes(sources, [&](unsigned int i, MeshData &data)
+        {
+            missesBefore += data.acmrBefore * data.triangleCount();
+            missesAfter += data.acmrAfter * data.triangleCount();
+            triangles += data.triangleCount();
+            processMesh(data, scene->mMaterials[sources[i]->mMaterialIndex]);
+        }, keepVertexData ? VERTEX_FULL : vertexFormat, optimizations);
+        if (optimizations != OPTIMIZE_NONE && triangles > 0)
+            cout << "Model " << path << ": " << meshes.size() << " meshes, ACMR " << missesBefore / triangles
+                 << " -> " << missesAfter / triangles << " (bake it with tools/meshbake to skip this on load)" << endl;
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // maps a baked mesh cache and uploads its vertex and index data directly from the mapping, unless sourcePath
+    // names a model that changed since it was baked
+    bool loadCache(string const &path, string const &sourcePath)
     {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        MeshCacheFile file;
+        if (!file.open(path, sourcePath))
+            return false;
+        directory = path.substr(0, path.find_last_of('/'));
+        const MeshCacheHeader &header = file.header();
+        // resolve every material's textures once, meshes share them
+        vector<vector<Texture> > materials(header.materialCount);
+        for (unsigned int m = 0; m < header.materialCount; m++)
         {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            const MeshCacheMaterial &material = file.materials()[m];
+            for (unsigned int t = 0; t < material.textureCount; t++)
+            {
+                const MeshCacheTexture &texture = file.textures()[material.firstTexture + t];
+                materials[m].push_back(loadTexture(texture.path, materialTextureNames[texture.type]));
+            }
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        meshes.reserve(header.meshCount);
+        for (unsigned int i = 0; i < header.meshCount; i++)
         {
-            processNode(node->mChildren[i], scene);
+            const MeshCacheMesh &mesh = file.meshes()[i];
+            glm::vec3 boundsMin(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+            glm::vec3 boundsMax(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+            if (file.vertexFormat() == VERTEX_COMPACT)
+                meshes.emplace_back(file.compactVertices(mesh), mesh.vertexCount, file.indices(mesh), mesh.indexCount,
+                                    materials[mesh.material], boundsMin, boundsMax);
+            else
+                meshes.emplace_back(file.vertices(mesh), mesh.vertexCount, file.indices(mesh), mesh.indexCount,
+                                    materials[mesh.material], boundsMin, boundsMax);
+            meshes.back().lods.clear();
+            for (unsigned int l = 0; l < mesh.lodCount; l++)
+                meshes.back().lods.push_back(MeshLod{mesh.lods[l].firstIndex, mesh.lods[l].indexCount, mesh.lods[l].error});
         }
+        return true;
+    }
 
+    static bool endsWith(const string &value, const string &suffix)
+    {
+        return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // loads the material of a converted mesh and appends it to meshes, moving its data rather than copying it
+    void processMesh(MeshData &data, aiMaterial *material)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
         vector<Texture> textures;
 
-        // Walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
-        }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
-        }
         // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
         // Same applies to other texture as the following list summarizes:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
+        // ambient: texture_ambientN
+        for (unsigned int i = 0; i < MATERIAL_TEXTURE_TYPES; i++)
+            loadMaterialTextures(material, materialTextureTypes[i], materialTextureNames[i], textures);
 
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. ambient maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_ambient");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        if (keepVertexData)
+        {
+            meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures), vertexFormat);
+        }
+        else if (data.format == VERTEX_COMPACT)
+        {
+            meshes.emplace_back(data.compactVertices.data(), data.compactVertices.size(), data.indices.data(),
+                                data.indices.size(), std::move(textures), data.boundsMin, data.boundsMax);
+        }
+        else
+        {
+            // upload from the converted data, which is freed when we return
+            meshes.emplace_back(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size(),
+                                std::move(textures), data.boundsMin, data.boundsMax);
+        }
+        meshes.back().lods = data.lods;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // the resulting Texture structs are appended to textures.
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const string &typeName, vector<Texture> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
-        return textures;
+    }
+
+    // loads a texture relative to the model directory through the shared cache, so no file is loaded twice even
+    // across models
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        Texture texture;
+        texture.stream = TextureFromFile(path, this->directory, gammaCorrection);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture.stream);
+        return texture;
     }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// takes a reference on the shared cache, which streams the file in on a miss. Release it through TextureCache.
+StreamedTexture *TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureCache::shared().acquire(filename, gamma);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <iostream>
+#include <new>
+#include <utility>
+
+/**
+ * Fixed number of slots for long lived objects of one type, such as portals. Storage is part of the pool, creating
+ * and destroying objects only takes a slot from and returns it to a free list.
+ */
+template<typename T, unsigned int N>
+class Pool {
+public:
+    Pool() : freeList(0), live(0) {
+        for (unsigned int i = 0; i < N; i++) {
+            next[i] = i + 1;
+        }
+    }
+
+    Pool(const Pool &) = delete;
+
+    Pool &operator=(const Pool &) = delete;
+
+    // prints an error and returns nullptr when every slot is taken
+    template<typename... Args>
+    T *create(Args &&... args) {
+        if (freeList == N) {
+            std::cout << "ERROR::POOL::FULL " << N << " slots in use" << std::endl;
+            return nullptr;
+        }
+        unsigned int slot = freeList;
+        freeList = next[slot];
+        live++;
+        return new(slots[slot].bytes) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object) {
+        if (object == nullptr) {
+            return;
+        }
+        object->~T();
+        unsigned int slot = reinterpret_cast<Slot *>(object) - slots;
+        next[slot] = freeList;
+        freeList = slot;
+        live--;
+    }
+
+    unsigned int size() const { return live; }
+
+    static unsigned int capacity() { return N; }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    Slot slots[N];
+    unsigned int next[N]; // free list links, N ends it
+    unsigned int freeList;
+    unsigned int live;
+};
+
+#endif //POOL_H
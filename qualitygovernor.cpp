@@ -0,0 +1,64 @@
+#include "qualitygovernor.h"
+
+#include <algorithm>
+#include <iostream>
+
+// the average has to leave this band around the target before anything changes
+static const double DROP_ABOVE = 1.1;
+static const double RAISE_BELOW = 0.7;
+static const unsigned int MAX_RAISE_FRAMES = 4096;
+
+const unsigned int QualityGovernor::WINDOW;
+const unsigned int QualityGovernor::RAISE_FRAMES;
+const unsigned int QualityGovernor::SETTLE_FRAMES;
+
+QualityGovernor::QualityGovernor(double targetTime)
+        : targetTime(targetTime), current(QUALITY_LEVELS - 1), frame(0), windowCount(0), windowSum(0.0),
+          underBudget(0), raisedAt(0) {
+    std::fill(window, window + WINDOW, 0.0);
+    std::fill(raiseFrames, raiseFrames + QUALITY_LEVELS, RAISE_FRAMES);
+}
+
+bool QualityGovernor::update(double frameTime) {
+    frame++;
+    if (targetTime <= 0.0) {
+        return false;
+    }
+    unsigned int slot = windowCount % WINDOW;
+    windowSum += frameTime - window[slot];
+    window[slot] = frameTime;
+    windowCount++;
+    if (windowCount < WINDOW) {
+        return false;
+    }
+    double average = windowSum / WINDOW;
+    if (average > targetTime * DROP_ABOVE && current > 0) {
+        // falling back soon after a raise means that level does not fit here, be slower to try it again
+        if (raisedAt != 0 && frame - raisedAt < SETTLE_FRAMES) {
+            raiseFrames[current] = std::min(raiseFrames[current] * 2, MAX_RAISE_FRAMES);
+        }
+        change(current - 1, average);
+        return true;
+    }
+    underBudget = average < targetTime * RAISE_BELOW ? underBudget + 1 : 0;
+    if (current + 1 < QUALITY_LEVELS && underBudget >= raiseFrames[current + 1]) {
+        raisedAt = frame;
+        change(current + 1, average);
+        return true;
+    }
+    return false;
+}
+
+void QualityGovernor::change(unsigned int level, double average) {
+    log.push_back({frame, current, level, average});
+    std::cout << "Quality: level " << current << " -> " << level << " at frame " << frame << ", " << average
+              << " ms average for a " << targetTime << " ms target (portal depth " << qualityLevels[level].portalDepth
+              << ", portal resolution " << qualityLevels[level].portalResolution << ", LOD bias "
+              << qualityLevels[level].lodBias << ")" << std::endl;
+    current = level;
+    // the new level is judged on its own frames only
+    std::fill(window, window + WINDOW, 0.0);
+    windowCount = 0;
+    windowSum = 0.0;
+    underBudget = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef QUALITYGOVERNOR_H
+#define QUALITYGOVERNOR_H
+
+#include <cstddef>
+#include <vector>
+
+// what a quality level trades for frame time
+struct QualitySettings {
+    int portalDepth; // portal levels whose views are rendered, 0 keeps showing the last portal images
+    float portalResolution; // of portal render targets, relative to the screen
+    float lodBias; // added to texture mip selection, higher is blurrier and cheaper
+};
+
+// cheapest first; the governor moves one level at a time
+const unsigned int QUALITY_LEVELS = 5;
+const QualitySettings qualityLevels[QUALITY_LEVELS] = {
+        {0, 0.5f, 1.0f},
+        {1, 0.5f, 1.0f},
+        {1, 0.75f, 0.5f},
+        {1, 0.75f, 0.0f},
+        {1, 1.0f, 0.0f},
+};
+
+/**
+ * Holds frame time to a target by moving between quality levels. Frames are judged by the average of a window of
+ * recent frame times: one full window over budget drops a level straight away, while raising takes a long run of
+ * frames well under budget. A level that was raised to and then dropped from quickly needs twice as long a run next
+ * time, so the governor settles instead of flipping between two levels where the cost swings, such as looking into a
+ * portal and away again.
+ *
+ * Every change is printed and kept in decisions().
+ */
+class QualityGovernor {
+public:
+    struct Decision {
+        unsigned int frame;
+        unsigned int from, to;
+        double averageTime; // ms over the window that decided it
+    };
+
+    // frames averaged before a drop
+    static const unsigned int WINDOW = 30;
+    // frames under budget a raise needs at first
+    static const unsigned int RAISE_FRAMES = 180;
+    // a drop within this many frames of raising into a level makes raising into it slower
+    static const unsigned int SETTLE_FRAMES = 300;
+
+    // targetTime in ms, 0 disables the governor and keeps the top level
+    explicit QualityGovernor(double targetTime);
+
+    // feeds the time of the frame just recorded, returns true when the level changed
+    bool update(double frameTime);
+
+    const QualitySettings &settings() const { return qualityLevels[current]; }
+
+    unsigned int level() const { return current; }
+
+    double target() const { return targetTime; }
+
+    const std::vector<Decision> &decisions() const { return log; }
+
+private:
+    double targetTime;
+    unsigned int current;
+    unsigned int frame;
+    double window[WINDOW];
+    unsigned int windowCount; // frames in window since the last change
+    double windowSum;
+    unsigned int underBudget; // consecutive frames averaging well under budget
+    unsigned int raisedAt; // frame of the last raise, 0 before the first
+    unsigned int raiseFrames[QUALITY_LEVELS]; // frames under budget needed to raise into each level
+    std::vector<Decision> log;
+
+    void change(unsigned int level, double average);
+};
+
+#endif //QUALITYGOVERNOR_H
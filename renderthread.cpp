@@ -0,0 +1,217 @@
+#include "renderthread.h"
+
+#include <algorithm>
+#include <chrono>
+
+void RenderCommandList::execute() const {
+    for (const Entry &entry : commands) {
+        entry.invoke(entry.command);
+    }
+}
+
+void RenderCommandList::clear() {
+    for (const Entry &entry : commands) {
+        entry.destroy(entry.command);
+    }
+    commands.clear();
+    arena.reset();
+}
+
+RenderThread::RenderThread(GLFWwindow *window)
+        : window(window), recording(0), submitted(false), pendingCall(nullptr), started(false), stopping(false),
+          appliedSwapInterval(-2), inFlightFirst(0), inFlightCount(0), timerFrame(0), lastGpuTime(0.0),
+          lastExecuteTime(0.0) {
+    std::fill(timerPending, timerPending + MAX_FRAMES_IN_FLIGHT + 1, false);
+}
+
+RenderThread::~RenderThread() {
+    stop();
+}
+
+void RenderThread::start() {
+    if (started) {
+        return;
+    }
+    // a context can only be current on one thread at a time
+    glfwMakeContextCurrent(nullptr);
+    stopping = false;
+    started = true;
+    nextFrame = Clock::now();
+    thread = std::thread(&RenderThread::run, this);
+}
+
+void RenderThread::submit(Clock::time_point inputTime) {
+    auto start = std::chrono::high_resolution_clock::now();
+    double frameRateCap;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !submitted; });
+        statistics.submitWait += std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+        inputTimes[recording] = inputTime;
+        recording = 1 - recording;
+        submitted = true;
+        frameRateCap = requestedPacing.frameRateCap;
+        wake.notify_one();
+    }
+    if (frameRateCap <= 0.0) {
+        return;
+    }
+    // frames are due at fixed intervals; after a long frame the schedule restarts instead of rushing to catch up
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / frameRateCap));
+    Clock::time_point now = Clock::now();
+    nextFrame = std::max(nextFrame + period, now);
+    auto sleepStart = std::chrono::high_resolution_clock::now();
+    sleepUntil(nextFrame);
+    statistics.paceSleep += std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - sleepStart).count();
+}
+
+void RenderThread::sleepUntil(Clock::time_point time) {
+    // the scheduler may oversleep by a millisecond or more, so the last stretch is spent yielding
+    const Clock::duration margin = std::chrono::milliseconds(2);
+    Clock::time_point now = Clock::now();
+    if (time - now > margin) {
+        std::this_thread::sleep_for(time - now - margin);
+    }
+    while (Clock::now() < time) {
+        std::this_thread::yield();
+    }
+}
+
+void RenderThread::setPacing(const FramePacing &settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    requestedPacing = settings;
+    requestedPacing.maxFramesInFlight = std::min(std::max(settings.maxFramesInFlight, 1u), MAX_FRAMES_IN_FLIGHT);
+}
+
+void RenderThread::readTimers() {
+    // oldest first, timerFrame being the slot the next frame reuses, so the newest finished frame is published last
+    const unsigned int slots = MAX_FRAMES_IN_FLIGHT + 1;
+    for (unsigned int k = 0; k < slots; k++) {
+        unsigned int i = (timerFrame + k) % slots;
+        if (!timerPending[i]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQueries[i], GL_QUERY_RESULT, &elapsed);
+            lastGpuTime = elapsed / 1e6;
+            timerPending[i] = false;
+        }
+    }
+}
+
+void RenderThread::retireFrames(unsigned int count) {
+    while (inFlightCount > 0) {
+        GLsync &fence = inFlight[inFlightFirst];
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            if (inFlightCount <= count) {
+                return;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            statistics.gpuWait += std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+        }
+        // an upper bound: the fence may have passed some time before it was checked
+        double latency = std::chrono::duration<double, std::milli>(
+                Clock::now() - inFlightInput[inFlightFirst]).count();
+        statistics.gpuLatency += latency;
+        statistics.maxGpuLatency = std::max(statistics.maxGpuLatency, latency);
+        statistics.gpuLatencyFrames++;
+        glDeleteSync(fence);
+        inFlightFirst = (inFlightFirst + 1) % MAX_FRAMES_IN_FLIGHT;
+        inFlightCount--;
+    }
+}
+
+void RenderThread::call(const std::function<void()> &command) {
+    if (!started) {
+        command();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    // the submitted frame may still refer to what command changes, so it goes first
+    done.wait(lock, [this] { return !submitted; });
+    pendingCall = &command;
+    wake.notify_one();
+    done.wait(lock, [this] { return pendingCall == nullptr; });
+}
+
+void RenderThread::stop() {
+    if (!started) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    started = false;
+    glfwMakeContextCurrent(window);
+}
+
+void RenderThread::run() {
+    glfwMakeContextCurrent(window);
+    glGenQueries(MAX_FRAMES_IN_FLIGHT + 1, timerQueries);
+    std::unique_lock<std::mutex> lock(mutex);
+    pacing = requestedPacing;
+    while (true) {
+        wake.wait(lock, [this] { return submitted || pendingCall != nullptr || stopping; });
+        if (pendingCall != nullptr) {
+            lock.unlock();
+            (*pendingCall)();
+            lock.lock();
+            pendingCall = nullptr;
+            done.notify_all();
+        } else if (submitted) {
+            // the main thread records into the other list meanwhile and does not touch this one until submitted
+            // is cleared
+            RenderCommandList &list = lists[1 - recording];
+            Clock::time_point inputTime = inputTimes[1 - recording];
+            pacing = requestedPacing;
+            lock.unlock();
+            if (pacing.swapInterval != appliedSwapInterval) {
+                glfwSwapInterval(pacing.swapInterval);
+                appliedSwapInterval = pacing.swapInterval;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            // a query still pending from MAX_FRAMES_IN_FLIGHT frames ago is dropped rather than waited for
+            unsigned int timer = timerFrame++ % (MAX_FRAMES_IN_FLIGHT + 1);
+            glBeginQuery(GL_TIME_ELAPSED, timerQueries[timer]);
+            list.execute();
+            glEndQuery(GL_TIME_ELAPSED);
+            timerPending[timer] = true;
+            lastExecuteTime = std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+            glfwSwapBuffers(window);
+            statistics.swapLatency += std::chrono::duration<double, std::milli>(Clock::now() - inputTime).count();
+            // the GPU may run this many frames behind; the fewer, the sooner input shows on screen
+            unsigned int slot = (inFlightFirst + inFlightCount) % MAX_FRAMES_IN_FLIGHT;
+            inFlight[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            inFlightInput[slot] = inputTime;
+            inFlightCount++;
+            retireFrames(pacing.maxFramesInFlight - 1);
+            readTimers();
+            list.clear();
+            statistics.executeTime += std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+            lock.lock();
+            statistics.frames++;
+            submitted = false;
+            done.notify_all();
+        } else {
+            break;
+        }
+    }
+    lock.unlock();
+    retireFrames(0);
+    glDeleteQueries(MAX_FRAMES_IN_FLIGHT + 1, timerQueries);
+    glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,179 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <framearena.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// initial size of a command list's arena, it grows to what the largest frame records
+const size_t RENDER_COMMAND_ARENA = 64 * 1024;
+
+/**
+ * One frame of GL work, recorded on the main thread and replayed on the render thread. Commands capture everything
+ * they draw by value (views, draw packets, uniforms), so the main thread can go on with the next frame while they run.
+ *
+ * The captured state of each command is placed in the list's own arena rather than a std::function, and the list
+ * keeps both between frames, so recording a frame of the same size as the last one does not touch the heap.
+ */
+class RenderCommandList {
+public:
+    RenderCommandList() : arena(RENDER_COMMAND_ARENA) {}
+
+    ~RenderCommandList() { clear(); }
+
+    RenderCommandList(const RenderCommandList &) = delete;
+
+    RenderCommandList &operator=(const RenderCommandList &) = delete;
+
+    template<typename Command>
+    void record(Command command) {
+        Command *stored = arena.create<Command>(std::move(command));
+        commands.push_back({stored, &invoke<Command>, &destroy<Command>});
+    }
+
+    void execute() const;
+
+    void clear();
+
+    size_t size() const { return commands.size(); }
+
+    // bytes of captured state in the largest frame so far
+    size_t memory() const { return arena.peak(); }
+
+private:
+    struct Entry {
+        void *command;
+        void (*invoke)(void *);
+        void (*destroy)(void *);
+    };
+
+    template<typename Command>
+    static void invoke(void *command) { (*static_cast<Command *>(command))(); }
+
+    template<typename Command>
+    static void destroy(void *command) { static_cast<Command *>(command)->~Command(); }
+
+    LinearArena arena;
+    std::vector<Entry> commands;
+};
+
+// most frames the GPU may be allowed to fall behind the swap
+const unsigned int MAX_FRAMES_IN_FLIGHT = 4;
+
+// trades throughput against latency, see RenderThread::setPacing
+struct FramePacing {
+    int swapInterval = 1; // vertical blanks per swap, 0 presents right away, -1 swaps late frames immediately
+    double frameRateCap = 0.0; // frames per second submit() holds the main thread to, 0 for no cap
+    unsigned int maxFramesInFlight = 2; // frames the GPU may lag behind the swap, 1 waits for every frame to finish
+};
+
+/**
+ * Owns the GL context once started and executes the frames the main thread submits, presenting each one. Two command
+ * lists are used in turn: while the render thread executes frame N the main thread records frame N+1 into the other
+ * list, and submit() only waits when frame N is still running by the time frame N+1 is recorded.
+ */
+class RenderThread {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // times in ms, summed over all frames
+    struct Stats {
+        unsigned int frames = 0;
+        double submitWait = 0.0; // the main thread spent in submit() waiting for the render thread
+        double executeTime = 0.0; // executing and presenting frames
+        double paceSleep = 0.0; // submit() held the main thread back for the frame rate cap
+        double gpuWait = 0.0; // the render thread waited for the GPU to stay within maxFramesInFlight
+        double swapLatency = 0.0; // from sampling a frame's input until its swap returned
+        double gpuLatency = 0.0; // from sampling a frame's input until the GPU was seen to be done with it
+        double maxGpuLatency = 0.0;
+        unsigned int gpuLatencyFrames = 0; // frames gpuLatency was measured for
+    };
+
+    explicit RenderThread(GLFWwindow *window);
+
+    ~RenderThread();
+
+    RenderThread(const RenderThread &) = delete;
+
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    // releases the context on the calling thread and makes it current on the render thread
+    void start();
+
+    // the list the main thread records the next frame into
+    RenderCommandList &commands() { return lists[recording]; }
+
+    // hands the recorded frame to the render thread, first waiting for the frame before it to finish. inputTime is
+    // when the input the frame reacts to was sampled, for the latency figures. With a frame rate cap it then sleeps
+    // until the next frame is due, so that frame samples its input as late as possible.
+    void submit(Clock::time_point inputTime = Clock::now());
+
+    // takes effect from the next submitted frame
+    void setPacing(const FramePacing &pacing);
+
+    // runs command on the render thread between two frames and waits for it, for GL work that cannot wait for the
+    // next frame such as creating objects. A submitted frame is executed first, so command may change what it used. Runs it right away on the calling thread while not started.
+    void call(const std::function<void()> &command);
+
+    // finishes the submitted frame and makes the context current on the calling thread again
+    void stop();
+
+    bool running() const { return started; }
+
+    // read after stop()
+    const Stats &stats() const { return statistics; }
+
+    // ms the GPU spent on the latest frame whose timer query is back, a few frames old; 0 until the first one
+    double gpuFrameTime() const { return lastGpuTime.load(); }
+
+    // ms the render thread spent issuing the last frame's commands, without the swap
+    double executeFrameTime() const { return lastExecuteTime.load(); }
+
+private:
+    GLFWwindow *window;
+    RenderCommandList lists[2];
+    unsigned int recording; // lists[1 - recording] is the submitted frame
+    bool submitted;
+    const std::function<void()> *pendingCall;
+    bool started, stopping;
+    std::mutex mutex; // guards submitted, pendingCall, stopping and requestedPacing
+    std::condition_variable wake, done;
+    std::thread thread;
+    Stats statistics;
+    FramePacing requestedPacing, pacing; // pacing is the render thread's copy
+    int appliedSwapInterval;
+    Clock::time_point inputTimes[2]; // per list
+    Clock::time_point nextFrame; // when submit() lets the main thread start the next frame
+    // fences after each swap the GPU may still be working on, oldest first
+    GLsync inFlight[MAX_FRAMES_IN_FLIGHT];
+    Clock::time_point inFlightInput[MAX_FRAMES_IN_FLIGHT];
+    unsigned int inFlightFirst, inFlightCount;
+    // GL_TIME_ELAPSED per frame, used in turn and read back once available
+    GLuint timerQueries[MAX_FRAMES_IN_FLIGHT + 1];
+    bool timerPending[MAX_FRAMES_IN_FLIGHT + 1];
+    unsigned int timerFrame;
+    std::atomic<double> lastGpuTime, lastExecuteTime;
+
+    void run();
+
+    // waits for frames until at most count are in flight, and retires those the GPU has finished anyway
+    void retireFrames(unsigned int count);
+
+    void sleepUntil(Clock::time_point time);
+
+    // reads back every finished timer query in the order the frames were submitted
+    void readTimers();
+};
+
+#endif //RENDERTHREAD_H
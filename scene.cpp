@@ -0,0 +1,66 @@
+#include "scene.h"
+
+unsigned int Scene::add(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale,
+                        const glm::vec3 &localMin, const glm::vec3 &localMax, unsigned int kind) {
+    unsigned int id = transforms.add(position, rotation, scale);
+    SceneObject object = {localMin, localMax, kind, Bvh::NONE, true};
+    objects.push_back(object);
+    return id;
+}
+
+void Scene::remove(unsigned int id) {
+    if (id >= objects.size() || !objects[id].alive) {
+        return;
+    }
+    if (objects[id].proxy != Bvh::NONE) {
+        tree.remove(objects[id].proxy);
+    }
+    objects[id].proxy = Bvh::NONE;
+    objects[id].alive = false;
+}
+
+void Scene::move(unsigned int id, const glm::vec3 &position, const glm::quat &rotation) {
+    if (id >= objects.size() || !objects[id].alive) {
+        return;
+    }
+    transforms.setPosition(id, position);
+    transforms.setRotation(id, rotation);
+}
+
+size_t Scene::update() {
+    updated.clear();
+    if (transforms.update(&updated) == 0) {
+        return 0;
+    }
+    for (unsigned int id : updated) {
+        SceneObject &object = objects[id];
+        if (!object.alive) {
+            continue;
+        }
+        glm::vec3 center, extent;
+        transformBounds(object.localMin, object.localMax, transforms.world(id), center, extent);
+        if (object.proxy == Bvh::NONE) {
+            object.proxy = tree.insert(center - extent, center + extent, id);
+        } else {
+            tree.move(object.proxy, center - extent, center + extent);
+        }
+    }
+    return updated.size();
+}
+
+void Scene::query(const Frustum &frustum, std::vector<unsigned int> &ids) const {
+    tree.query(frustum, ids);
+}
+
+void Scene::all(std::vector<unsigned int> &ids) const {
+    for (unsigned int id = 0; id < objects.size(); id++) {
+        if (objects[id].proxy != Bvh::NONE) {
+            ids.push_back(id);
+        }
+    }
+}
+
+bool Scene::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &id,
+                    float &distance) const {
+    return tree.raycast(origin, direction, maxDistance, id, distance);
+}
@@ -0,0 +1,68 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <bvh.h>
+#include <frustum.h>
+#include <transformstore.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// one placed object: a local space box under the object's transform, kind says what to draw for it
+struct SceneObject {
+    glm::vec3 localMin, localMax;
+    unsigned int kind;
+    int proxy; // Bvh::NONE until the first update()
+    bool alive;
+};
+
+/**
+ * The placed objects of a level, indexed by a Bvh over their world space boxes so views and rays only visit the
+ * objects near them. An object's id is also its index in the TransformStore. Ids stay valid until the object is
+ * removed and are not reused.
+ *
+ * Adding or moving an object only marks its transform dirty; update() rebuilds the dirty world matrices and refits
+ * the tree around them, and does nothing at all while the scene stands still.
+ */
+class Scene {
+public:
+    unsigned int add(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale,
+                     const glm::vec3 &localMin, const glm::vec3 &localMax, unsigned int kind = 0);
+
+    void remove(unsigned int id);
+
+    void move(unsigned int id, const glm::vec3 &position, const glm::quat &rotation);
+
+    // world matrices and tree of everything added or moved since the last call. Returns how many objects changed.
+    size_t update();
+
+    const SceneObject &object(unsigned int id) const { return objects[id]; }
+
+    // as of the last update()
+    const glm::mat4 &model(unsigned int id) const { return transforms.world(id); }
+
+    // objects in the scene as of the last update(), not counting removed ones
+    size_t size() const { return tree.leafCount(); }
+
+    // ids of the objects whose boxes intersect the frustum, appended to ids. Only reads the scene, so views can query
+    // from several threads at once as long as nothing is added, moved or updated meanwhile.
+    void query(const Frustum &frustum, std::vector<unsigned int> &ids) const;
+
+    // ids of every object, for views that cannot be culled
+    void all(std::vector<unsigned int> &ids) const;
+
+    // nearest object whose box the ray enters within maxDistance, distance in multiples of direction
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, unsigned int &id,
+                 float &distance) const;
+
+    int depth() const { return tree.height(); }
+
+private:
+    std::vector<SceneObject> objects;
+    TransformStore transforms;
+    Bvh tree;
+    std::vector<unsigned int> updated;
+};
+
+#endif //SCENE_H
@@ -0,0 +1,336 @@
+#include "scenefile.h"
+#include "texturefile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+size_t SceneDescription::memory() const {
+    return meshes.size() * sizeof(SceneFileMesh) + materials.size() * sizeof(SceneFileMaterial)
+           + instances.size() * sizeof(SceneFileInstance) + portals.size() * sizeof(SceneFilePortal)
+           + vertices.size() * sizeof(float);
+}
+
+int SceneDescription::findMesh(const std::string &name) const {
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        if (name == meshes[i].name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool copyName(char *destination, size_t size, const std::string &name) {
+    if (name.empty() || name.size() >= size) {
+        return false;
+    }
+    memset(destination, 0, size);
+    memcpy(destination, name.c_str(), name.size());
+    return true;
+}
+
+static int findMaterial(const SceneDescription &scene, const std::string &name) {
+    for (unsigned int i = 0; i < scene.materials.size(); i++) {
+        if (name == scene.materials[i].name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void meshBounds(SceneFileMesh &mesh, const std::vector<float> &vertices) {
+    for (int axis = 0; axis < 3; axis++) {
+        mesh.boundsMin[axis] = mesh.vertexCount == 0 ? 0.0f : HUGE_VALF;
+        mesh.boundsMax[axis] = mesh.vertexCount == 0 ? 0.0f : -HUGE_VALF;
+    }
+    for (uint32_t v = mesh.firstVertex; v < mesh.firstVertex + mesh.vertexCount; v++) {
+        for (int axis = 0; axis < 3; axis++) {
+            float value = vertices[(size_t) v * SCENE_VERTEX_FLOATS + axis];
+            mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], value);
+            mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], value);
+        }
+    }
+}
+
+static bool parseError(const std::string &path, unsigned int line, const std::string &reason) {
+    std::cout << "ERROR::SCENE_FILE::PARSE " << path << ":" << line << " " << reason << std::endl;
+    return false;
+}
+
+bool parseSceneText(const std::string &path, SceneDescription &scene) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::COULD_NOT_OPEN " << path << std::endl;
+        return false;
+    }
+    scene = SceneDescription();
+    SceneFileMesh *mesh = nullptr; // inside mesh ... end
+    std::string text;
+    unsigned int line = 0;
+    while (std::getline(file, text)) {
+        line++;
+        text = text.substr(0, text.find('#'));
+        std::istringstream in(text);
+        std::string statement;
+        if (!(in >> statement)) {
+            continue;
+        }
+        if (mesh != nullptr) {
+            if (statement == "end") {
+                meshBounds(*mesh, scene.vertices);
+                mesh = nullptr;
+                continue;
+            }
+            float vertex[SCENE_VERTEX_FLOATS];
+            for (float &value : vertex) {
+                in >> value;
+            }
+            if (statement != "v" || !in) {
+                return parseError(path, line, "expected v x y z u v or end");
+            }
+            scene.vertices.insert(scene.vertices.end(), vertex, vertex + SCENE_VERTEX_FLOATS);
+            mesh->vertexCount++;
+        } else if (statement == "mesh") {
+            std::string name;
+            in >> name;
+            SceneFileMesh record = {};
+            if (!copyName(record.name, sizeof(record.name), name)) {
+                return parseError(path, line, "missing or too long mesh name");
+            }
+            record.firstVertex = scene.vertexCount();
+            scene.meshes.push_back(record);
+            mesh = &scene.meshes.back();
+        } else if (statement == "material") {
+            std::string name, program, texture;
+            in >> name >> program;
+            SceneFileMaterial record = {};
+            if (!copyName(record.name, sizeof(record.name), name)) {
+                return parseError(path, line, "missing or too long material name");
+            }
+            record.program = std::find(sceneProgramNames, sceneProgramNames + SCENE_PROGRAM_COUNT, program)
+                             - sceneProgramNames;
+            if (record.program == SCENE_PROGRAM_COUNT) {
+                return parseError(path, line, "unknown program " + program);
+            }
+            while (in >> texture) {
+                if (record.textureCount == MAX_SCENE_TEXTURES ||
+                    !copyName(record.textures[record.textureCount], SCENE_PATH_LENGTH, texture)) {
+                    return parseError(path, line, "too many textures or texture path too long");
+                }
+                record.textureCount++;
+            }
+            scene.materials.push_back(record);
+        } else if (statement == "instance") {
+            std::string meshName, materialName;
+            float angle = 0.0f, axis[3] = {0.0f, 1.0f, 0.0f}, scale = 1.0f;
+            SceneFileInstance record = {};
+            in >> meshName >> materialName >> record.position[0] >> record.position[1] >> record.position[2];
+            if (!in) {
+                return parseError(path, line, "expected instance <mesh> <material> <x y z>");
+            }
+            int meshIndex = scene.findMesh(meshName), materialIndex = findMaterial(scene, materialName);
+            if (meshIndex < 0 || materialIndex < 0) {
+                return parseError(path, line, "unknown mesh or material, they have to be declared first");
+            }
+            if (in >> angle) {
+                in >> axis[0] >> axis[1] >> axis[2];
+                if (!in) {
+                    return parseError(path, line, "rotation needs an angle and an axis");
+                }
+                if (!(in >> scale)) {
+                    scale = 1.0f;
+                }
+            }
+            record.mesh = meshIndex;
+            record.material = materialIndex;
+            float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            float half = angle * 3.14159265f / 360.0f;
+            for (int i = 0; i < 3; i++) {
+                record.rotation[i] = length > 0.0f ? axis[i] / length * std::sin(half) : 0.0f;
+                record.scale[i] = scale;
+            }
+            record.rotation[3] = length > 0.0f ? std::cos(half) : 1.0f;
+            scene.instances.push_back(record);
+        } else if (statement == "portal") {
+            SceneFilePortal record = {};
+            for (int end = 0; end < 2; end++) {
+                in >> record.position[end][0] >> record.position[end][1] >> record.position[end][2];
+                in >> record.normal[end][0] >> record.normal[end][1] >> record.normal[end][2];
+            }
+            if (!in) {
+                return parseError(path, line, "expected two positions with their normals");
+            }
+            scene.portals.push_back(record);
+        } else {
+            return parseError(path, line, "unknown statement " + statement);
+        }
+    }
+    if (mesh != nullptr) {
+        return parseError(path, line, "mesh without end");
+    }
+    return true;
+}
+
+bool writeSceneFile(const std::string &path, const SceneDescription &scene) {
+    SceneFileHeader header = {};
+    memcpy(header.magic, "PSCN", 4);
+    header.version = SCENE_FILE_VERSION;
+    header.meshCount = scene.meshes.size();
+    header.materialCount = scene.materials.size();
+    header.instanceCount = scene.instances.size();
+    header.portalCount = scene.portals.size();
+    header.vertexCount = scene.vertexCount();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) scene.meshes.data(), scene.meshes.size() * sizeof(SceneFileMesh));
+    file.write((const char *) scene.materials.data(), scene.materials.size() * sizeof(SceneFileMaterial));
+    file.write((const char *) scene.instances.data(), scene.instances.size() * sizeof(SceneFileInstance));
+    file.write((const char *) scene.portals.data(), scene.portals.size() * sizeof(SceneFilePortal));
+    file.write((const char *) scene.vertices.data(), scene.vertices.size() * sizeof(float));
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::COULD_NOT_WRITE " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+static void readRecords(std::ifstream &file, std::vector<T> &records, size_t count) {
+    records.resize(count);
+    file.read((char *) records.data(), count * sizeof(T));
+}
+
+bool readSceneFile(const std::string &path, SceneDescription &scene) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::COULD_NOT_OPEN " << path << std::endl;
+        return false;
+    }
+    uint64_t size = file.tellg();
+    file.seekg(0);
+    SceneFileHeader header = {};
+    file.read((char *) &header, sizeof(header));
+    // the counts decide every size below, so they are checked against the file before anything is allocated
+    bool valid = file && memcmp(header.magic, "PSCN", 4) == 0 && header.version == SCENE_FILE_VERSION &&
+                 header.vertexCount <= size / (SCENE_VERTEX_FLOATS * sizeof(float)) &&
+                 size == sizeof(header) + (uint64_t) header.meshCount * sizeof(SceneFileMesh)
+                         + (uint64_t) header.materialCount * sizeof(SceneFileMaterial)
+                         + (uint64_t) header.instanceCount * sizeof(SceneFileInstance)
+                         + (uint64_t) header.portalCount * sizeof(SceneFilePortal)
+                         + header.vertexCount * SCENE_VERTEX_FLOATS * sizeof(float);
+    if (!valid) {
+        std::cout << "ERROR::SCENE_FILE::INVALID_OR_OUTDATED " << path << std::endl;
+        return false;
+    }
+    readRecords(file, scene.meshes, header.meshCount);
+    readRecords(file, scene.materials, header.materialCount);
+    readRecords(file, scene.instances, header.instanceCount);
+    readRecords(file, scene.portals, header.portalCount);
+    readRecords(file, scene.vertices, header.vertexCount * SCENE_VERTEX_FLOATS);
+    if (!file) {
+        std::cout << "ERROR::SCENE_FILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool finite(const float *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (!std::isfinite(values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool terminated(const char *text, size_t size) {
+    return memchr(text, 0, size) != nullptr;
+}
+
+bool validateScene(const SceneDescription &scene, const std::string &path) {
+    unsigned int problems = 0;
+    auto problem = [&](const char *kind, unsigned int index, const std::string &detail) {
+        std::cout << "ERROR::SCENE_FILE::" << kind << " " << path << " #" << index << " " << detail << std::endl;
+        problems++;
+    };
+    if (scene.vertices.size() % SCENE_VERTEX_FLOATS != 0 || !finite(scene.vertices.data(), scene.vertices.size())) {
+        problem("INVALID_VERTICES", 0, "vertex data is cut off or not finite");
+    }
+    for (unsigned int i = 0; i < scene.meshes.size(); i++) {
+        const SceneFileMesh &mesh = scene.meshes[i];
+        if (!terminated(mesh.name, sizeof(mesh.name))) {
+            problem("INVALID_MESH", i, "name not terminated");
+        } else if (mesh.vertexCount == 0 || mesh.vertexCount % 3 != 0) {
+            problem("INVALID_MESH", i, std::string(mesh.name) + " needs whole triangles");
+        } else if ((uint64_t) mesh.firstVertex + mesh.vertexCount > scene.vertexCount()) {
+            problem("INVALID_MESH", i, std::string(mesh.name) + " vertices out of range");
+        }
+    }
+    for (unsigned int i = 0; i < scene.materials.size(); i++) {
+        const SceneFileMaterial &material = scene.materials[i];
+        if (!terminated(material.name, sizeof(material.name))) {
+            problem("INVALID_MATERIAL", i, "name not terminated");
+        } else if (material.program >= SCENE_PROGRAM_COUNT) {
+            problem("INVALID_MATERIAL", i, std::string(material.name) + " unknown program");
+        } else if (material.textureCount != sceneProgramTextures[material.program]) {
+            problem("INVALID_MATERIAL", i, std::string(material.name) + " " + sceneProgramNames[material.program]
+                                           + " takes " + std::to_string(sceneProgramTextures[material.program])
+                                           + " textures");
+        } else {
+            for (unsigned int t = 0; t < material.textureCount; t++) {
+                if (!terminated(material.textures[t], SCENE_PATH_LENGTH)) {
+                    problem("INVALID_MATERIAL", i, std::string(material.name) + " texture path not terminated");
+                } else if (!std::ifstream(material.textures[t]) &&
+                           !std::ifstream(std::string(material.textures[t]) + TEXTURE_FILE_EXTENSION)) {
+                    problem("MISSING_TEXTURE", i, material.textures[t]);
+                }
+            }
+        }
+    }
+    for (unsigned int i = 0; i < scene.instances.size(); i++) {
+        const SceneFileInstance &instance = scene.instances[i];
+        const float *q = instance.rotation;
+        float length = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+        if (instance.mesh >= scene.meshes.size() || instance.material >= scene.materials.size()) {
+            problem("INVALID_INSTANCE", i, "mesh or material out of range");
+        } else if (!finite(instance.position, 3) || !finite(q, 4) || !finite(instance.scale, 3)) {
+            problem("INVALID_INSTANCE", i, "transform not finite");
+        } else if (std::fabs(length - 1.0f) > 1e-3f) {
+            problem("INVALID_INSTANCE", i, "rotation is not a unit quaternion");
+        } else if (instance.scale[0] == 0.0f || instance.scale[1] == 0.0f || instance.scale[2] == 0.0f) {
+            problem("INVALID_INSTANCE", i, "zero scale");
+        }
+    }
+    // the game keeps a single pair of portals
+    if (scene.portals.size() > 1) {
+        problem("TOO_MANY_PORTALS", 1, "only one pair is used");
+    }
+    for (unsigned int i = 0; i < scene.portals.size(); i++) {
+        const SceneFilePortal &portal = scene.portals[i];
+        for (int end = 0; end < 2; end++) {
+            const float *n = portal.normal[end];
+            if (!finite(portal.position[end], 3) || !finite(n, 3) || n[0] * n[0] + n[1] * n[1] + n[2] * n[2] == 0.0f) {
+                problem("INVALID_PORTAL", i, "position or normal not usable");
+            }
+        }
+    }
+    return problems == 0;
+}
+
+bool loadSceneFile(const std::string &path, SceneDescription &scene) {
+    std::string baked = path + SCENE_FILE_EXTENSION;
+    // a baked file older than the text would silently drop edits, so the text wins then
+    struct stat bakedInfo, textInfo;
+    bool useBaked = stat(baked.c_str(), &bakedInfo) == 0;
+    if (useBaked && stat(path.c_str(), &textInfo) == 0 && textInfo.st_mtime > bakedInfo.st_mtime) {
+        std::cout << "ERROR::SCENE_FILE::STALE " << baked << " is older than " << path << std::endl;
+        useBaked = false;
+    }
+    bool loaded = useBaked ? readSceneFile(baked, scene) : parseSceneText(path, scene);
+    return loaded && validateScene(scene, path);
+}
@@ -0,0 +1,121 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Level description: meshes, the materials they are drawn with, the placed instances and portal pairs that exist
+ * from the start. Levels are authored as text and can be compiled to a binary file that loads with a handful of bulk
+ * reads, since its records are the structs below exactly as SceneDescription holds them:
+ *
+ *   SceneFileHeader
+ *   SceneFileMesh[meshCount]
+ *   SceneFileMaterial[materialCount]
+ *   SceneFileInstance[instanceCount]
+ *   SceneFilePortal[portalCount]
+ *   float vertex[vertexCount * SCENE_VERTEX_FLOATS]
+ *
+ * The text format has one statement per line, # starts a comment:
+ *
+ *   mesh <name>                                 followed by one "v x y z u v" line per vertex and "end",
+ *                                               every three vertices are a triangle
+ *   material <name> <program> <texture>...      program is one of sceneProgramNames, textures are loaded flipped
+ *   instance <mesh> <material> <x y z> [<angle> <axis x y z> [<scale>]]    angle in degrees
+ *   portal <x y z> <normal x y z> <x y z> <normal x y z>
+ *
+ * Binary files are written by tools/scenebake and preferred by loadSceneFile when they sit next to the text file and
+ * are not older than it.
+ */
+const char *const SCENE_FILE_EXTENSION = ".pscene";
+const uint32_t SCENE_FILE_VERSION = 1;
+
+// position and texture coordinates
+const unsigned int SCENE_VERTEX_FLOATS = 5;
+const unsigned int SCENE_NAME_LENGTH = 32;
+const unsigned int SCENE_PATH_LENGTH = 128;
+const unsigned int MAX_SCENE_TEXTURES = 2;
+
+// the shader families a material can be drawn with, and how many textures each samples
+enum SceneProgram : uint32_t {
+    SCENE_PROGRAM_BOX = 0,
+    SCENE_PROGRAM_FLOOR = 1,
+    SCENE_PROGRAM_COUNT
+};
+const char *const sceneProgramNames[SCENE_PROGRAM_COUNT] = {"box", "floor"};
+const unsigned int sceneProgramTextures[SCENE_PROGRAM_COUNT] = {2, 1};
+
+struct SceneFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t instanceCount;
+    uint32_t portalCount;
+    uint64_t vertexCount;
+};
+
+struct SceneFileMesh {
+    char name[SCENE_NAME_LENGTH];
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct SceneFileMaterial {
+    char name[SCENE_NAME_LENGTH];
+    uint32_t program; // SceneProgram
+    uint32_t textureCount;
+    char textures[MAX_SCENE_TEXTURES][SCENE_PATH_LENGTH];
+};
+
+struct SceneFileInstance {
+    uint32_t mesh;
+    uint32_t material;
+    float position[3];
+    float rotation[4]; // quaternion, w last
+    float scale[3];
+};
+
+// the two ends of a portal pair
+struct SceneFilePortal {
+    float position[2][3];
+    float normal[2][3];
+};
+
+struct SceneDescription {
+    std::vector<SceneFileMesh> meshes;
+    std::vector<SceneFileMaterial> materials;
+    std::vector<SceneFileInstance> instances;
+    std::vector<SceneFilePortal> portals;
+    std::vector<float> vertices;
+
+    size_t vertexCount() const { return vertices.size() / SCENE_VERTEX_FLOATS; }
+
+    // bytes held by the description, for load reports
+    size_t memory() const;
+
+    // index of the named mesh, or -1
+    int findMesh(const std::string &name) const;
+};
+
+// prints the line and reason and returns false on a syntax error
+bool parseSceneText(const std::string &path, SceneDescription &scene);
+
+bool writeSceneFile(const std::string &path, const SceneDescription &scene);
+
+// prints the reason and returns false for a missing, truncated or outdated file
+bool readSceneFile(const std::string &path, SceneDescription &scene);
+
+// checks every reference, count and number in the description, printing each problem found. Returns true if the
+// level can be loaded as it is.
+bool validateScene(const SceneDescription &scene, const std::string &path);
+
+// reads path + SCENE_FILE_EXTENSION when it exists and is at least as new as path, path itself otherwise, then
+// validates the result
+bool loadSceneFile(const std::string &path, SceneDescription &scene);
+
+#endif //SCENEFILE_H
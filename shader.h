@@ -8,15 +8,29 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <vector>
+
+#include <shadercache.h>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 class Shader
 {
 public:
+    // handles of the uniforms every program in this project shares, registered up front so draw code never looks them up
+    enum { MODEL, VIEW, PROJECTION, COLOR, CLIP_PLANE, MATERIAL_LAYERS, POSITION_OFFSET, POSITION_SCALE };
+
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // defines are inserted after the #version line of every stage, see ShaderVariants
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string &defines = "")
+        : defines(defines)
     {
+        auto start = std::chrono::high_resolution_clock::now();
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -57,49 +71,176 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
+        vertexFile = vertexPath;
+        fragmentFile = fragmentPath;
+        geometryFile = geometryPath != nullptr ? geometryPath : "";
+        ID = glCreateProgram();
+        // 2. try the program binary cache before compiling anything
+        cacheKey = ShaderCache::key({&defines, &vertexCode, &fragmentCode, &geometryCode});
+        vertexSource = vertexCode;
+        fragmentSource = fragmentCode;
+        geometrySource = geometryCode;
+        if (ShaderCache::load(ID, cacheKey))
+        {
+            refreshUniforms();
+            ShaderCache::stats().hits++;
+        }
+        else
+        {
+            // only issue the work here; status is queried in finish() so the driver can compile in the background
+            linkKey = cacheKey;
+            compileAndLink(vertexCode, fragmentCode, geometryPath != nullptr ? &geometryCode : nullptr);
+            linking = true;
+            ShaderCache::stats().misses++;
+        }
+        // standard handles go after the program exists; while linking they stay -1 until finish() resolves them
+        for (const char *name : {"model", "view", "projection", "color", "clipPlane", "materialLayers", "positionOffset",
+                                 "positionScale"})
+            uniform(name);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        ShaderCache::stats().milliseconds += elapsed.count();
+    }
+    // returns true once the program is linked, without blocking when KHR_parallel_shader_compile is present
+    // ------------------------------------------------------------------------
+    bool isReady()
+    {
+        if (!linking)
+            return true;
+        if (parallelCompile())
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+        finish();
+        return true;
+    }
+    // checks compile and link results; blocks if the driver is still working on them
+    // ------------------------------------------------------------------------
+    bool finish()
+    {
+        if (!linking)
+            return true;
+        auto start = std::chrono::high_resolution_clock::now();
+        linking = false;
         checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
-        {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
+        if (geometry != 0)
             checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        GLint success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (success)
+        {
+            ShaderCache::store(ID, linkKey);
+            refreshUniforms();
+        }
         // delete the shaders as they're linked into our program now and no longer necessery
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-        if(geometryPath != nullptr)
+        if (geometry != 0)
+        {
+            glDetachShader(ID, geometry);
             glDeleteShader(geometry);
-
+        }
+        vertex = fragment = geometry = 0;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        ShaderCache::stats().milliseconds += elapsed.count();
+        return success == GL_TRUE;
+    }
+    // relinks from new sources between frames; on any error the previous program stays in place.
+    // uniform values, uniform handles and block bindings carry over to the new program.
+    // ------------------------------------------------------------------------
+    bool reload(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode)
+    {
+        finish();
+        GLuint previous = ID;
+        ID = glCreateProgram();
+        // cacheKey keeps naming the previous sources until the new ones are known to link
+        uint64_t key = ShaderCache::key({&defines, &vertexCode, &fragmentCode, &geometryCode});
+        linkKey = key;
+        compileAndLink(vertexCode, fragmentCode, geometryFile.empty() ? nullptr : &geometryCode);
+        linking = true;
+        if (!finish())
+        {
+            glDeleteProgram(ID);
+            ID = previous;
+            return false;
+        }
+        cacheKey = key;
+        transferUniforms(previous, ID);
+        glDeleteProgram(previous);
+        vertexSource = vertexCode;
+        fragmentSource = fragmentCode;
+        geometrySource = geometryCode;
+        return true;
+    }
+    // polls every program once; use this to keep drawing a loading frame instead of blocking on the slowest link
+    // ------------------------------------------------------------------------
+    static bool allReady(const std::vector<Shader *> &shaders)
+    {
+        bool ready = true;
+        for (Shader *shader : shaders)
+            ready = shader->isReady() && ready;
+        return ready;
+    }
+    // KHR_parallel_shader_compile lets the driver link on its own threads and report completion without stalling
+    // ------------------------------------------------------------------------
+    static bool parallelCompile()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count && !supported; i++)
+            {
+                const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+                supported = name != nullptr && std::string(name) == "GL_KHR_parallel_shader_compile";
+            }
+#ifdef GL_KHR_parallel_shader_compile
+            if (supported && glMaxShaderCompilerThreadsKHR != nullptr)
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+        }
+        return supported == 1;
+    }
+    // returns a handle whose location is re-resolved on every relink; resolve once, then set by handle every frame
+    // ------------------------------------------------------------------------
+    int uniform(const std::string &name)
+    {
+        for (unsigned int i = 0; i < uniformNames.size(); i++)
+            if (uniformNames[i] == name)
+                return i;
+        uniformNames.push_back(name);
+        uniformLocations.push_back(linking ? -1 : glGetUniformLocation(ID, name.c_str()));
+        return uniformNames.size() - 1;
+    }
+    // binds a named uniform block to a binding point; reapplied after every relink
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &name, unsigned int binding)
+    {
+        blockBindings.push_back(std::make_pair(name, binding));
+        if (!linking)
+            applyBlockBinding(blockBindings.back());
+    }
+    // assigns a sampler uniform to a texture unit once the program is linked; reapplied after every relink
+    // ------------------------------------------------------------------------
+    void bindSampler(const std::string &name, int unit)
+    {
+        samplerBindings.push_back(std::make_pair(name, unit));
+        if (!linking)
+            applySamplerBinding(samplerBindings.back());
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
     {
+        finish();
         glUseProgram(ID);
     }
     // utility uniform functions
@@ -160,8 +301,175 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    // handle based setters, see uniform()
+    // ------------------------------------------------------------------------
+    void setInt(int handle, int value) const
+    {
+        glUniform1i(uniformLocations[handle], value);
+    }
+    void setFloat(int handle, float value) const
+    {
+        glUniform1f(uniformLocations[handle], value);
+    }
+    void setVec3(int handle, const glm::vec3 &value) const
+    {
+        glUniform3fv(uniformLocations[handle], 1, &value[0]);
+    }
+    void setVec4(int handle, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniformLocations[handle], 1, &value[0]);
+    }
+    void setIVec4(int handle, const glm::ivec4 &value) const
+    {
+        glUniform4iv(uniformLocations[handle], 1, &value[0]);
+    }
+    void setMat4(int handle, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(uniformLocations[handle], 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // source files and the sources last linked from them, used by the hot reloader
+    const std::string defines;
+    std::string vertexFile, fragmentFile, geometryFile;
+    std::string vertexSource, fragmentSource, geometrySource;
 
 private:
+    unsigned int vertex = 0, fragment = 0, geometry = 0;
+    bool linking = false;
+    uint64_t cacheKey = 0; // sources of the program in ID
+    uint64_t linkKey = 0; // sources being linked, the binary is cached under it once they link
+    std::vector<std::string> uniformNames;
+    std::vector<GLint> uniformLocations;
+    std::vector<std::pair<std::string, unsigned int> > blockBindings;
+    std::vector<std::pair<std::string, int> > samplerBindings;
+
+    // #define lines have to follow #version, everything else may come after them
+    std::string withDefines(const std::string &source) const
+    {
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return defines + source;
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + defines;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+    void applyBlockBinding(const std::pair<std::string, unsigned int> &block)
+    {
+        GLuint index = glGetUniformBlockIndex(ID, block.first.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, block.second);
+    }
+
+    void applySamplerBinding(const std::pair<std::string, int> &sampler)
+    {
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(ID);
+        glUniform1i(glGetUniformLocation(ID, sampler.first.c_str()), sampler.second);
+        glUseProgram(current);
+    }
+
+    // re-resolves every handed out uniform handle, block and sampler binding against the current ID
+    void refreshUniforms()
+    {
+        for (unsigned int i = 0; i < uniformNames.size(); i++)
+            uniformLocations[i] = glGetUniformLocation(ID, uniformNames[i].c_str());
+        for (auto &block : blockBindings)
+            applyBlockBinding(block);
+        for (auto &sampler : samplerBindings)
+            applySamplerBinding(sampler);
+    }
+
+    // copies the values of all default block uniforms (samplers included) that exist in both programs
+    static void transferUniforms(GLuint from, GLuint to)
+    {
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(to);
+        GLint count = 0;
+        glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLchar name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(from, i, sizeof(name), nullptr, &size, &type, name);
+            std::string base(name);
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.resize(base.size() - 3);
+            for (GLint element = 0; element < size; element++)
+            {
+                std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+                GLint source = glGetUniformLocation(from, elementName.c_str());
+                GLint target = glGetUniformLocation(to, elementName.c_str());
+                if (source < 0 || target < 0)
+                    continue; // uniform block members and uniforms removed by the edit
+                GLfloat f[16];
+                GLint v[4];
+                switch (type)
+                {
+                    case GL_FLOAT: glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+                    case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+                    case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+                    case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+                    case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+                    case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+                    case GL_INT_VEC2: glGetUniformiv(from, source, v); glUniform2iv(target, 1, v); break;
+                    case GL_INT_VEC3: glGetUniformiv(from, source, v); glUniform3iv(target, 1, v); break;
+                    case GL_INT_VEC4: glGetUniformiv(from, source, v); glUniform4iv(target, 1, v); break;
+                    case GL_INT:
+                    case GL_BOOL:
+                    case GL_SAMPLER_2D:
+                    case GL_SAMPLER_2D_ARRAY:
+                    case GL_SAMPLER_CUBE:
+                        glGetUniformiv(from, source, v);
+                        glUniform1iv(target, 1, v);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        glUseProgram(current == (GLint) from ? to : current);
+    }
+
+    // issues compilation of the given sources and the link into ID, leaving the status checks to finish()
+    // ------------------------------------------------------------------------
+    void compileAndLink(const std::string &vertexCode, const std::string &fragmentCode, const std::string *geometryCode)
+    {
+        std::string vertexVariant = withDefines(vertexCode);
+        std::string fragmentVariant = withDefines(fragmentCode);
+        std::string geometryVariant = geometryCode != nullptr ? withDefines(*geometryCode) : "";
+        const char* vShaderCode = vertexVariant.c_str();
+        const char * fShaderCode = fragmentVariant.c_str();
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        // if geometry shader is given, compile geometry shader
+        if(geometryCode != nullptr)
+        {
+            const char * gShaderCode = geometryVariant.c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+        }
+        // shader Program
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if(geometryCode != nullptr)
+            glAttachShader(ID, geometry);
+        ShaderCache::prepare(ID);
+        glLinkProgram(ID);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,211 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <initializer_list>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// The binary entry points only exist when glad was generated for GL 4.1 or with ARB_get_program_binary.
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define SHADERCACHE_HAS_PROGRAM_BINARY 1
+#endif
+
+/**
+ * Stores linked program binaries on disk so later runs can skip compiling and linking.
+ * Entries are keyed by a hash of the shader sources and the GL vendor/renderer/version strings,
+ * so a driver update or an edited shader simply misses the cache and recompiles.
+ */
+class ShaderCache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        double milliseconds = 0.0;
+    };
+
+    static Stats &stats()
+    {
+        static Stats s;
+        return s;
+    }
+
+    static std::string &directory()
+    {
+        static std::string dir = "shadercache";
+        return dir;
+    }
+
+    static bool enabled()
+    {
+#ifdef SHADERCACHE_HAS_PROGRAM_BINARY
+        static int formats = -1;
+        if (formats < 0)
+        {
+            formats = 0;
+            if (glProgramBinary != nullptr && glGetProgramBinary != nullptr)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        return formats > 0;
+#else
+        return false;
+#endif
+    }
+
+    // 64 bit FNV-1a over the defines and each stage's source plus the driver identification strings. Every part is
+    // preceded by its length, so text moving from one stage to the next gives a different key.
+    static uint64_t key(std::initializer_list<const std::string *> sources)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto bytes = [&hash](const char *data, size_t length)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                hash ^= (unsigned char) data[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        auto mix = [&bytes](const char *data, size_t length)
+        {
+            uint64_t size = length;
+            bytes((const char *) &size, sizeof(size));
+            bytes(data, length);
+        };
+        for (const std::string *source : sources)
+            mix(source->data(), source->size());
+        const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for (GLenum name : names)
+        {
+            const char *value = (const char *) glGetString(name);
+            if (value != nullptr)
+                mix(value, std::char_traits<char>::length(value));
+        }
+        return hash;
+    }
+
+    // must be called before glLinkProgram for drivers to keep a retrievable binary around
+    static void prepare(GLuint program)
+    {
+#ifdef SHADERCACHE_HAS_PROGRAM_BINARY
+        if (enabled())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+    }
+
+    // tries to initialise the program from a cached binary; returns false on a miss or a rejected binary
+    static bool load(GLuint program, uint64_t key)
+    {
+#ifdef SHADERCACHE_HAS_PROGRAM_BINARY
+        if (!enabled())
+            return false;
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        Header header;
+        if (!file.read((char *) &header, sizeof(header)) || header.magic != MAGIC || header.key != key)
+            return false;
+        // the length comes from disk, a truncated or corrupt file must not get to size the allocation
+        std::streampos start = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streamoff remaining = file.tellg() - start;
+        file.seekg(start);
+        if (!file || header.length == 0 || (std::streamoff) header.length != remaining)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), header.length))
+            return false;
+        glProgramBinary(program, header.format, binary.data(), (GLsizei) header.length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        // the driver rejects binaries it no longer understands; the caller falls back to compiling
+        return success == GL_TRUE;
+#else
+        return false;
+#endif
+    }
+
+    static void store(GLuint program, uint64_t key)
+    {
+#ifdef SHADERCACHE_HAS_PROGRAM_BINARY
+        if (!enabled())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Header header;
+        header.key = key;
+        std::vector<char> binary(length);
+        glGetProgramBinary(program, length, nullptr, &header.format, binary.data());
+        header.length = (uint32_t) length;
+        makeDirectory();
+        std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "WARNING::SHADER_CACHE::COULD_NOT_WRITE " << path(key) << std::endl;
+            return;
+        }
+        file.write((const char *) &header, sizeof(header));
+        file.write(binary.data(), length);
+#endif
+    }
+
+    static void report()
+    {
+        const Stats &s = stats();
+        std::cout << "Shaders: " << s.hits + s.misses << " programs in " << s.milliseconds << " ms ("
+                  << s.hits << " from cache, " << s.misses << " compiled"
+                  << (enabled() ? "" : ", program binaries unsupported") << ")" << std::endl;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x43425350; // "PSBC"
+
+    struct Header
+    {
+        uint32_t magic = MAGIC;
+        uint32_t length = 0;
+        uint64_t key = 0;
+        GLenum format = 0;
+    };
+
+    static std::string path(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+        return directory() + "/" + name;
+    }
+
+    static void makeDirectory()
+    {
+#ifdef _WIN32
+        _mkdir(directory().c_str());
+#else
+        mkdir(directory().c_str(), 0755);
+#endif
+    }
+};
+#endif
@@ -2,8 +2,9 @@
 out vec4 FragColor;
 in vec2 TexCoord;
 
-uniform sampler2D tex;
+uniform sampler2DArray tex;
+uniform ivec4 materialLayers; // x: floor layer
 
 void main() {
-    FragColor = texture(tex, TexCoord);
+    FragColor = texture(tex, vec3(TexCoord, materialLayers.x));
 }
@@ -1,15 +1,36 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+#ifdef INSTANCING
+layout (location = 2) in mat4 aModel;
+#endif
 
 uniform mat4 model;
+#ifdef UBO_CAMERA
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+#else
 uniform mat4 view;
 uniform mat4 projection;
+#endif
+#ifdef OBLIQUE_CLIP
+uniform vec4 clipPlane;
+#endif
 
 out vec2 TexCoord;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef INSTANCING
+    vec4 worldPos = aModel * model * vec4(aPos, 1.0);
+#else
+    vec4 worldPos = model * vec4(aPos, 1.0);
+#endif
+#ifdef OBLIQUE_CLIP
+    gl_ClipDistance[0] = dot(clipPlane, worldPos);
+#endif
+    gl_Position = projection * view * worldPos;
 
     TexCoord = aTexCoord;
 }
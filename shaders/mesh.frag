@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoord;
+in mat3 TBN;
+
+uniform sampler2DArray texture_diffuse;
+uniform ivec4 materialLayers; // x: diffuse layer, see Mesh::Draw
+
+const vec3 lightDirection = vec3(0.267, 0.802, 0.535);
+
+void main() {
+    vec4 diffuse = texture(texture_diffuse, vec3(TexCoord, materialLayers.x));
+    float light = 0.3 + 0.7 * max(dot(normalize(TBN[2]), lightDirection), 0.0);
+    FragColor = vec4(diffuse.rgb * light, diffuse.a);
+}
@@ -0,0 +1,66 @@
+#version 330 core
+#ifdef COMPACT_VERTEX
+// CompactVertex, see vertexformat.h. Normalised shorts arrive in [-1, 1], halves as floats.
+layout (location = 0) in vec4 aPos; // xyz within the mesh bounds, w the bitangent sign
+layout (location = 1) in vec2 aNormal; // octahedral
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec2 aTangent; // octahedral
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+#else
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+
+uniform mat4 model;
+#ifdef UBO_CAMERA
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+#else
+uniform mat4 view;
+uniform mat4 projection;
+#endif
+#ifdef OBLIQUE_CLIP
+uniform vec4 clipPlane;
+#endif
+
+out vec2 TexCoord;
+out mat3 TBN;
+
+#ifdef COMPACT_VERTEX
+vec3 octahedralDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -fold : fold;
+    v.y += v.y >= 0.0 ? -fold : fold;
+    return normalize(v);
+}
+#endif
+
+void main() {
+#ifdef COMPACT_VERTEX
+    vec3 position = positionOffset + positionScale * aPos.xyz;
+    vec3 normal = octahedralDecode(aNormal);
+    vec3 tangent = octahedralDecode(aTangent);
+    vec3 bitangent = cross(normal, tangent) * (aPos.w < 0.0 ? -1.0 : 1.0);
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    vec3 bitangent = aBitangent;
+#endif
+    vec4 worldPos = model * vec4(position, 1.0);
+#ifdef OBLIQUE_CLIP
+    gl_ClipDistance[0] = dot(clipPlane, worldPos);
+#endif
+    gl_Position = projection * view * worldPos;
+
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    TBN = mat3(normalize(normalMatrix * tangent), normalize(normalMatrix * bitangent), normalize(normalMatrix * normal));
+    TexCoord = aTexCoord;
+}
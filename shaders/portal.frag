@@ -1,13 +1,23 @@
 #version 330 core
 out vec4 FragColor;
-in vec2 TexCoord;
 
 uniform vec3 color;
+#ifdef TEXTURED
+in vec2 TexCoord;
 uniform sampler2D texture;
+#endif
 
 void main() {
+#ifdef TEXTURED
     FragColor = texture(texture, TexCoord);
     //This doesn't work
     //FragColor = texture(texture, gl_FragCoord.xy/gl_FragCoord.z);
     //FragColor = vec4(TexCoord, 0, 0);
+#else
+    //Solid colour, used for portal borders and the debugging cameras
+    FragColor = vec4(color, 1.0);
+#endif
+#ifdef DEBUG_COLOUR
+    FragColor = mix(FragColor, vec4(color, 1.0), 0.3);
+#endif
 }
@@ -6,12 +6,16 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#ifdef TEXTURED
 out vec2 TexCoord;
+#endif
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef TEXTURED
     //Coordinates in screen space:
     vec3 ndc = gl_Position.xyz / gl_Position.w;
     vec2 viewportCoord = (ndc.xy * 0.5 + 0.5);
     TexCoord = viewportCoord;
+#endif
 }
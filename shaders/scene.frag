@@ -2,10 +2,11 @@
 out vec4 FragColor;
 in vec2 TexCoord;
 
-uniform sampler2D wood;
-uniform sampler2D smiley;
+uniform sampler2DArray wood;
+uniform sampler2DArray smiley;
+uniform ivec4 materialLayers; // x: wood layer, y: smiley layer
 
 void main()
 {
-   FragColor = mix(texture(wood, TexCoord), texture(smiley, TexCoord), 0.2);
+   FragColor = mix(texture(wood, vec3(TexCoord, materialLayers.x)), texture(smiley, vec3(TexCoord, materialLayers.y)), 0.2);
 }
\ No newline at end of file
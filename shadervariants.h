@@ -0,0 +1,77 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <shader.h>
+#include <shaderwatcher.h>
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * Generates program variants from one vertex/fragment source pair by prepending #defines for a set of feature bits.
+ * Variants are compiled the first time they are requested and cached afterwards, so draw code can hold on to a
+ * specialised program instead of branching on uniforms in the shader.
+ */
+class ShaderVariants
+{
+public:
+    enum Feature
+    {
+        INSTANCING   = 1 << 0, // model matrix from a per instance attribute at locations 2-5
+        UBO_CAMERA   = 1 << 1, // view and projection from the Camera uniform block
+        OBLIQUE_CLIP = 1 << 2, // clip against the clipPlane uniform through gl_ClipDistance[0]
+        DEBUG_COLOUR = 1 << 3, // tint output with the color uniform
+        TEXTURED     = 1 << 4, // sample a texture instead of writing a solid colour
+        COMPACT_VERTEX = 1 << 5 // decode quantised CompactVertex attributes, see vertexformat.h
+    };
+
+    // binding point the Camera block of every UBO_CAMERA variant is attached to
+    static const unsigned int CAMERA_BLOCK_BINDING = 0;
+
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, ShaderWatcher *watcher = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), watcher(watcher)
+    {
+    }
+
+    // returns the variant for the given feature bits, compiling it on first use
+    Shader *get(unsigned int features)
+    {
+        auto found = variants.find(features);
+        if (found != variants.end())
+            return found->second;
+        Shader *shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, defines(features));
+        if (features & UBO_CAMERA)
+            shader->bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+        for (auto &sampler : samplers)
+            shader->bindSampler(sampler.first, sampler.second);
+        if (watcher != nullptr)
+            watcher->watch(shader);
+        variants[features] = shader;
+        return shader;
+    }
+
+    // sampler units shared by every variant, applied as soon as each one has linked
+    void bindSampler(const std::string &name, int unit)
+    {
+        samplers.push_back(std::make_pair(name, unit));
+        for (auto &variant : variants)
+            variant.second->bindSampler(name, unit);
+    }
+
+    static std::string defines(unsigned int features)
+    {
+        static const char *names[] = {"INSTANCING", "UBO_CAMERA", "OBLIQUE_CLIP", "DEBUG_COLOUR", "TEXTURED", "COMPACT_VERTEX"};
+        std::string result;
+        for (unsigned int bit = 0; bit < sizeof(names) / sizeof(names[0]); bit++)
+            if (features & (1u << bit))
+                result += std::string("#define ") + names[bit] + "\n";
+        return result;
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    ShaderWatcher *watcher;
+    std::unordered_map<unsigned int, Shader *> variants;
+    std::vector<std::pair<std::string, int> > samplers;
+};
+#endif
@@ -0,0 +1,137 @@
+#include "shaderwatcher.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher() : running(false), fd(-1) {
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    stop();
+}
+
+void ShaderWatcher::watch(Shader *shader) {
+    std::lock_guard<std::mutex> lock(mutex);
+    shaders.push_back(shader);
+    for (auto *file : {&shader->vertexFile, &shader->fragmentFile, &shader->geometryFile}) {
+        if (!file->empty() && files.insert(*file).second && running) {
+            addDirectory(*file);
+        }
+    }
+}
+
+// watch directories rather than files, editors usually save by replacing the file
+void ShaderWatcher::addDirectory(const std::string &file) {
+#ifdef __linux__
+    size_t slash = file.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : file.substr(0, slash);
+    int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        std::cout << "ERROR::SHADER_WATCHER::CANNOT_WATCH " << directory << std::endl;
+    } else {
+        directories[wd] = directory;
+    }
+#endif
+}
+
+void ShaderWatcher::start() {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK);
+    if (fd < 0) {
+        std::cout << "ERROR::SHADER_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &file : files) {
+        addDirectory(file);
+    }
+    running = true;
+    thread = std::thread(&ShaderWatcher::run, this);
+#else
+    std::cout << "Shader hot reload is only available on Linux" << std::endl;
+#endif
+}
+
+void ShaderWatcher::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+void ShaderWatcher::run() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    while (running) {
+        pollfd descriptor = {fd, POLLIN, 0};
+        if (poll(&descriptor, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            auto *event = (inotify_event *) (buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            std::string path;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::string directory = directories[event->wd];
+                path = directory == "." ? event->name : directory + "/" + event->name;
+                if (files.count(path) == 0) {
+                    continue;
+                }
+            }
+            // prepare the new source here so the GL thread only has to compile
+            std::ifstream file(path);
+            std::stringstream source;
+            source << file.rdbuf();
+            if (source.str().empty()) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            changed[path] = source.str();
+        }
+    }
+#endif
+}
+
+void ShaderWatcher::applyChanges() {
+    std::map<std::string, std::string> sources;
+    std::vector<Shader *> watched;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (changed.empty()) {
+            return;
+        }
+        sources.swap(changed);
+        watched = shaders;
+    }
+    for (Shader *shader : watched) {
+        auto vertex = sources.find(shader->vertexFile);
+        auto fragment = sources.find(shader->fragmentFile);
+        auto geometry = sources.find(shader->geometryFile);
+        if (vertex == sources.end() && fragment == sources.end() && geometry == sources.end()) {
+            continue;
+        }
+        bool reloaded = shader->reload(vertex != sources.end() ? vertex->second : shader->vertexSource,
+                                       fragment != sources.end() ? fragment->second : shader->fragmentSource,
+                                       geometry != sources.end() ? geometry->second : shader->geometrySource);
+        std::cout << (reloaded ? "Reloaded " : "Reload failed, keeping previous program for ")
+                  << shader->vertexFile << " + " << shader->fragmentFile << std::endl;
+    }
+}
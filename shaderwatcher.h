@@ -0,0 +1,52 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <shader.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Hot reloads shaders when their source files change on disk.
+ * A background thread waits on inotify and reads the changed files; applyChanges() then relinks only the affected
+ * programs on the GL thread, between frames. A program that fails to compile or link keeps running the old version.
+ * Inotify is Linux only, on other platforms the watcher does nothing.
+ */
+class ShaderWatcher {
+public:
+    ShaderWatcher();
+
+    ~ShaderWatcher();
+
+    // may be called before or after start(), e.g. for shader variants compiled on demand
+    void watch(Shader *shader);
+
+    void start();
+
+    void stop();
+
+    // swaps in programs for the sources changed since the last call. Call on the GL thread between frames.
+    void applyChanges();
+
+private:
+    std::vector<Shader *> shaders;
+    std::set<std::string> files;
+    std::map<int, std::string> directories; // inotify watch descriptor -> watched directory
+    std::map<std::string, std::string> changed; // path -> new source, filled by the watcher thread
+    std::mutex mutex; // guards shaders, files, directories and changed
+    std::thread thread;
+    std::atomic<bool> running;
+    int fd;
+
+    void addDirectory(const std::string &file);
+
+    void run();
+};
+
+
+#endif //SHADERWATCHER_H
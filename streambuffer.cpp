@@ -0,0 +1,154 @@
+#include "streambuffer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// glBufferStorage only exists when glad was generated for GL 4.4 or with ARB_buffer_storage.
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAMBUFFER_HAS_BUFFER_STORAGE 1
+#endif
+
+StreamBuffer::StreamBuffer(size_t regionSize)
+        : name(0), mapped(nullptr), mappedRange(false), regionSize(regionSize), uniformOffsetAlignment(256),
+          region(0), used(0) {
+    std::fill(fences, fences + REGIONS, (GLsync) nullptr);
+}
+
+void StreamBuffer::create() {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uniformOffsetAlignment = std::max<GLint>(alignment, 16);
+    // regions start on a uniform block boundary
+    regionSize = (regionSize + uniformOffsetAlignment - 1) / uniformOffsetAlignment * uniformOffsetAlignment;
+    size_t size = regionSize * REGIONS;
+    glGenBuffers(1, &name);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+#ifdef STREAMBUFFER_HAS_BUFFER_STORAGE
+    if (glBufferStorage != nullptr) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        mapped = (unsigned char *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+    }
+#endif
+    if (mapped == nullptr) {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    region = REGIONS - 1;
+    used = 0;
+}
+
+void StreamBuffer::destroy() {
+    for (GLsync &fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (name != 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+        if (mapped != nullptr || mappedRange) {
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &name);
+        name = 0;
+        mapped = nullptr;
+        mappedRange = false;
+    }
+}
+
+void StreamBuffer::waitFor(GLsync &fence) {
+    if (fence == nullptr) {
+        return;
+    }
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::high_resolution_clock::now();
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        statistics.fenceWaits++;
+        statistics.waitTime += std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamBuffer::grow(size_t size) {
+    // every region is replaced, so the GPU has to be done with all of them. Draws already issued from the old buffer
+    // keep its storage alive until they ran.
+    for (GLsync &fence : fences) {
+        waitFor(fence);
+    }
+    unsigned int current = region;
+    destroy();
+    while (regionSize < size) {
+        regionSize *= 2;
+    }
+    create();
+    region = current;
+    used = 0;
+}
+
+void StreamBuffer::beginFrame() {
+    region = (region + 1) % REGIONS;
+    used = 0;
+    if (mapped != nullptr) {
+        waitFor(fences[region]);
+    } else if (region == 0) {
+        // fresh storage for the next round of regions, the driver keeps the old one until the GPU is done with it
+        glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize * REGIONS, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void *StreamBuffer::map(size_t size, size_t alignment, GLintptr &offset) {
+    size_t start = (used + alignment - 1) / alignment * alignment;
+    if (start + size > regionSize) {
+        // dropping the write would drop geometry from the frame, so pay for a stall once instead
+        statistics.overflows++;
+        grow(std::max(regionSize * 2, size));
+        start = 0;
+    }
+    used = start + size;
+    offset = region * regionSize + start;
+    statistics.bytesLastFrame = used;
+    statistics.peak = std::max(statistics.peak, used);
+    if (mapped != nullptr) {
+        return mapped + offset;
+    }
+    // nothing else in this frame's region was written yet, so there is nothing to synchronise with
+    glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    void *range = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mappedRange = range != nullptr;
+    return range;
+}
+
+void StreamBuffer::unmap() {
+    if (!mappedRange) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mappedRange = false;
+}
+
+void StreamBuffer::endFrame() {
+    if (mapped != nullptr) {
+        if (fences[region] != nullptr) {
+            glDeleteSync(fences[region]);
+        }
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/**
+ * GPU buffer for data written every frame, such as view matrices and instance transforms. It is split into one region
+ * per frame the GPU may still be reading; each frame appends to its own region and fences it when done, and the next
+ * frame to use that region waits for the fence first. With buffer storage the whole buffer stays mapped persistent and
+ * coherent, so data is written straight into GPU visible memory and only a bind is left per view. Without it every
+ * write maps its range unsynchronized and the buffer is orphaned whenever the regions come round again.
+ *
+ * The same buffer can be bound as uniform block range and as vertex attribute source. All calls on the GL thread.
+ */
+class StreamBuffer {
+public:
+    struct Stats {
+        size_t bytesLastFrame = 0;
+        size_t peak = 0; // most bytes a frame used
+        unsigned int fenceWaits = 0; // frames that had to wait for the GPU to release their region
+        double waitTime = 0.0; // ms spent waiting
+        unsigned int overflows = 0; // writes that did not fit the region and grew the buffer mid frame
+    };
+
+    static const unsigned int REGIONS = 3;
+
+    explicit StreamBuffer(size_t regionSize);
+
+    void create();
+
+    void destroy();
+
+    // moves on to the next region, waiting until the GPU is done with it
+    void beginFrame();
+
+    // space for size bytes at an offset into buffer() that is a multiple of alignment, written through the returned
+    // pointer. When the frame's region is full the buffer is replaced by a larger one on the spot, so buffer() has to
+    // be read again after every map(). Returns nullptr only when the driver fails to map.
+    void *map(size_t size, size_t alignment, GLintptr &offset);
+
+    // makes what was written since map() visible to the GPU, before any draw reads it
+    void unmap();
+
+    // fences the region after the last draw reading it
+    void endFrame();
+
+    GLuint buffer() const { return name; }
+
+    // required alignment of uniform block ranges
+    size_t uniformAlignment() const { return uniformOffsetAlignment; }
+
+    bool persistent() const { return mapped != nullptr; }
+
+    const Stats &stats() const { return statistics; }
+
+private:
+    GLuint name;
+    unsigned char *mapped; // whole buffer when persistent
+    bool mappedRange; // fallback map open between map() and unmap()
+    size_t regionSize;
+    size_t uniformOffsetAlignment;
+    unsigned int region;
+    size_t used; // bytes of the current region
+    GLsync fences[REGIONS];
+    Stats statistics;
+
+    void waitFor(GLsync &fence);
+
+    // recreates the buffer with regions of at least size bytes, staying in the current region
+    void grow(size_t size);
+};
+
+#endif //STREAMBUFFER_H
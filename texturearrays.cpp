@@ -0,0 +1,99 @@
+#include "texturearrays.h"
+
+#include <algorithm>
+
+TextureArrays::TextureArrays() : lodBias(0.0f) {
+}
+
+TextureLayer TextureArrays::allocate(int width, int height, GLenum internalFormat, int levels, int blockBytes) {
+    Key key(width, height, internalFormat, levels);
+    Group &group = groups[key];
+    if (!group.freeLayers.empty()) {
+        TextureLayer layer = group.freeLayers.back();
+        group.freeLayers.pop_back();
+        return layer;
+    }
+    if (group.nextLayer == LAYERS_PER_ARRAY) {
+        group.arrays.push_back(createArray(key, blockBytes, lodBias));
+        owners[group.arrays.back()] = key;
+        group.nextLayer = 0;
+    }
+    TextureLayer layer;
+    layer.array = group.arrays.back();
+    layer.layer = group.nextLayer++;
+    return layer;
+}
+
+void TextureArrays::release(const TextureLayer &layer) {
+    auto owner = owners.find(layer.array);
+    if (owner != owners.end()) {
+        groups[owner->second].freeLayers.push_back(layer);
+    }
+}
+
+unsigned int TextureArrays::createArray(const Key &key, int blockBytes, float lodBias) {
+    int width = std::get<0>(key), height = std::get<1>(key), levels = std::get<3>(key);
+    GLenum format = std::get<2>(key);
+    unsigned int array;
+    glGenTextures(1, &array);
+    bind(UPLOAD_UNIT, array);
+    // every level is allocated up front, glTexStorage3D needs GL 4.2
+    for (int level = 0; level < levels; level++) {
+        int w = std::max(1, width >> level), h = std::max(1, height >> level);
+        if (blockBytes > 0) {
+            GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * blockBytes * LAYERS_PER_ARRAY;
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, w, h, LAYERS_PER_ARRAY, 0, size, nullptr);
+        } else {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, w, h, LAYERS_PER_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         nullptr);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_LOD_BIAS, lodBias);
+    return array;
+}
+
+void TextureArrays::setLodBias(float bias) {
+    lodBias = bias;
+    for (auto &owner : owners) {
+        bind(UPLOAD_UNIT, owner.first);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_LOD_BIAS, lodBias);
+    }
+}
+
+// nullptr for units beyond the ones cached
+unsigned int *TextureArrays::bound(unsigned int unit) {
+    static unsigned int arrays[TEXTURE_UNITS] = {};
+    return unit < TEXTURE_UNITS ? &arrays[unit] : nullptr;
+}
+
+void TextureArrays::bind(unsigned int unit, unsigned int array) {
+    unsigned int *cached = bound(unit);
+    if (cached != nullptr) {
+        if (*cached == array) {
+            return;
+        }
+        *cached = array;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+}
+
+void TextureArrays::destroy() {
+    for (auto &group : groups) {
+        glDeleteTextures(group.second.arrays.size(), group.second.arrays.data());
+    }
+    groups.clear();
+    owners.clear();
+    for (unsigned int unit = 0; unit < TEXTURE_UNITS; unit++) {
+        *bound(unit) = 0;
+    }
+}
+
+size_t TextureArrays::arrayCount() const {
+    return owners.size();
+}
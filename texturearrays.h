@@ -0,0 +1,68 @@
+#ifndef TEXTUREARRAYS_H
+#define TEXTUREARRAYS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// where a texture lives: a layer of a GL_TEXTURE_2D_ARRAY
+struct TextureLayer {
+    unsigned int array = 0;
+    int layer = 0;
+};
+
+/**
+ * Packs textures of the same size, format and mip count into shared 2D array textures, so draws pick their material
+ * with a layer index instead of binding another texture. Arrays have a fixed number of layers; a group that runs out
+ * starts another array, and layers freed by evicted textures are reused first.
+ */
+class TextureArrays {
+public:
+    static const int LAYERS_PER_ARRAY = 16;
+    static const int TEXTURE_UNITS = 16;
+    // arrays are created and filled through this unit, keep it free of material bindings
+    static const unsigned int UPLOAD_UNIT = TEXTURE_UNITS - 1;
+
+    TextureArrays();
+
+    // blockBytes is the size of a 4x4 block for compressed formats and 0 otherwise
+    TextureLayer allocate(int width, int height, GLenum internalFormat, int levels, int blockBytes = 0);
+
+    void release(const TextureLayer &layer);
+
+    // binds an array to a texture unit unless it is bound there already, leaving that unit active when it binds.
+    // Arrays are only ever bound through here, so the cache stays valid whatever is bound to GL_TEXTURE_2D on the
+    // same unit.
+    static void bind(unsigned int unit, unsigned int array);
+
+    // biases mip selection of every array, present and future; positive values sample smaller levels
+    void setLodBias(float bias);
+
+    // deletes every array. Call while the GL context is still current.
+    void destroy();
+
+    size_t arrayCount() const;
+
+private:
+    typedef std::tuple<int, int, GLenum, int> Key; // width, height, internal format, levels
+
+    struct Group {
+        std::vector<unsigned int> arrays;
+        std::vector<TextureLayer> freeLayers;
+        int nextLayer = LAYERS_PER_ARRAY; // in arrays.back()
+    };
+
+    std::map<Key, Group> groups;
+    std::map<unsigned int, Key> owners; // array -> group
+    float lodBias;
+
+    static unsigned int *bound(unsigned int unit);
+
+    static unsigned int createArray(const Key &key, int blockBytes, float lodBias);
+};
+
+
+#endif //TEXTUREARRAYS_H
@@ -0,0 +1,109 @@
+#include "texturecache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+TextureCache::TextureCache(TextureStreamer &streamer, size_t budget) : streamer(streamer), budget(budget) {
+}
+
+TextureCache &TextureCache::shared() {
+    static TextureCache cache(TextureStreamer::shared());
+    return cache;
+}
+
+std::string TextureCache::normalise(const std::string &path) {
+    std::string unified = path;
+    std::replace(unified.begin(), unified.end(), '\\', '/');
+#ifdef _WIN32
+    // file names are case insensitive on Windows
+    std::transform(unified.begin(), unified.end(), unified.begin(), [](unsigned char c) { return std::tolower(c); });
+#endif
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= unified.size()) {
+        size_t end = unified.find('/', begin);
+        if (end == std::string::npos) {
+            end = unified.size();
+        }
+        std::string part = unified.substr(begin, end - begin);
+        if (part == "..") {
+            if (!parts.empty() && parts.back() != "..") {
+                parts.pop_back();
+            } else {
+                parts.push_back(part);
+            }
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        begin = end + 1;
+    }
+    std::string result = !unified.empty() && unified[0] == '/' ? "/" : "";
+    for (size_t i = 0; i < parts.size(); i++) {
+        result += (i > 0 ? "/" : "") + parts[i];
+    }
+    return result;
+}
+
+StreamedTexture *TextureCache::acquire(const std::string &path, bool gamma, bool flip) {
+    std::string key = normalise(path) + (gamma ? "|srgb" : "|linear") + (flip ? "|flip" : "");
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        Entry &entry = found->second;
+        if (entry.references++ == 0) {
+            unreferenced.erase(entry.unused);
+        }
+        statistics.hits++;
+        return entry.texture;
+    }
+    statistics.misses++;
+    StreamedTexture *texture = streamer.load(path, flip, gamma);
+    entries[key] = {texture, 1, unreferenced.end()};
+    keys[texture] = key;
+    return texture;
+}
+
+void TextureCache::release(StreamedTexture *texture) {
+    auto key = keys.find(texture);
+    if (key == keys.end()) {
+        return;
+    }
+    Entry &entry = entries[key->second];
+    if (--entry.references == 0) {
+        entry.unused = unreferenced.insert(unreferenced.end(), key->second);
+        trim();
+    }
+}
+
+void TextureCache::setBudget(size_t bytes) {
+    budget = bytes;
+    trim();
+}
+
+void TextureCache::trim() {
+    size_t resident = residentBytes();
+    auto next = unreferenced.begin();
+    while (resident > budget && next != unreferenced.end()) {
+        auto entry = entries.find(*next);
+        StreamedTexture *texture = entry->second.texture;
+        resident -= bytes(texture);
+        keys.erase(texture);
+        entries.erase(entry);
+        next = unreferenced.erase(next);
+        streamer.unload(texture);
+        statistics.evictions++;
+    }
+}
+
+size_t TextureCache::residentBytes() const {
+    size_t total = 0;
+    for (auto &entry : entries) {
+        total += bytes(entry.second.texture);
+    }
+    return total;
+}
+
+// textures still streaming in count once they are ready
+size_t TextureCache::bytes(const StreamedTexture *texture) {
+    return texture->bytes;
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <texturestreamer.h>
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Shares textures between every Model and the scene. Entries are keyed by the normalised file path plus the load
+ * parameters and counted by reference. A texture nobody references any more stays resident, so reloading a level is
+ * free, until the resident size exceeds the budget; then the least recently released ones are deleted first.
+ */
+class TextureCache {
+public:
+    struct Stats {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        unsigned int evictions = 0;
+    };
+
+    static const size_t DEFAULT_BUDGET = 256u << 20;
+
+    explicit TextureCache(TextureStreamer &streamer, size_t budget = DEFAULT_BUDGET);
+
+    // the cache used by the model loader and the scene
+    static TextureCache &shared();
+
+    // returns the texture for path, streaming it in on a miss. Every acquire needs a matching release.
+    StreamedTexture *acquire(const std::string &path, bool gamma = false, bool flip = false);
+
+    void release(StreamedTexture *texture);
+
+    // bytes resident on the GPU at most, counting mipmaps; evicts unreferenced textures when lowered
+    void setBudget(size_t bytes);
+
+    // evicts unreferenced textures until the resident size fits the budget
+    void trim();
+
+    size_t residentBytes() const;
+
+    const Stats &stats() const { return statistics; }
+
+    // resolves "." and "..", turns backslashes into slashes and drops repeated separators
+    static std::string normalise(const std::string &path);
+
+private:
+    struct Entry {
+        StreamedTexture *texture;
+        unsigned int references;
+        std::list<std::string>::iterator unused; // position in unreferenced while references is 0
+    };
+
+    TextureStreamer &streamer;
+    size_t budget;
+    std::unordered_map<std::string, Entry> entries; // key -> entry
+    std::unordered_map<StreamedTexture *, std::string> keys; // texture -> key, for release()
+    std::list<std::string> unreferenced; // least recently released first
+    Stats statistics;
+
+    static size_t bytes(const StreamedTexture *texture);
+};
+
+
+#endif //TEXTURECACHE_H
@@ -0,0 +1,302 @@
+#include "texturefile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static uint64_t alignTo(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+static size_t blockSize(uint32_t format) {
+    return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+static uint16_t packColor(const unsigned char *rgb) {
+    return (uint16_t) (((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+static void unpackColor(uint16_t color, int *rgb) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// endpoints from the colour bounding box, inset by 1/16 of its extent so outliers do not waste the palette
+static void compressColorBlock(const unsigned char pixels[16][4], unsigned char *block) {
+    unsigned char low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            low[c] = std::min(low[c], pixels[i][c]);
+            high[c] = std::max(high[c], pixels[i][c]);
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        int inset = (high[c] - low[c]) >> 4;
+        low[c] = (unsigned char) std::min(255, low[c] + inset);
+        high[c] = (unsigned char) std::max(0, high[c] - inset);
+    }
+    uint16_t color0 = packColor(high), color1 = packColor(low);
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+    int palette[4][3];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = pixels[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t) best << (2 * i);
+        }
+    }
+    memcpy(block, &color0, 2);
+    memcpy(block + 2, &color1, 2);
+    memcpy(block + 4, &indices, 4);
+}
+
+static void compressAlphaBlock(const unsigned char pixels[16][4], unsigned char *block) {
+    unsigned char low = 255, high = 0;
+    for (int i = 0; i < 16; i++) {
+        low = std::min(low, pixels[i][3]);
+        high = std::max(high, pixels[i][3]);
+    }
+    // alpha0 > alpha1 selects the eight value palette
+    int palette[8] = {high, low};
+    for (int p = 1; p < 7; p++) {
+        palette[p + 1] = ((7 - p) * high + p * low) / 7;
+    }
+    uint64_t indices = 0;
+    if (high != low) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; p++) {
+                int distance = std::abs(pixels[i][3] - palette[p]);
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint64_t) best << (3 * i);
+        }
+    }
+    block[0] = high;
+    block[1] = low;
+    for (int b = 0; b < 6; b++) {
+        block[2 + b] = (unsigned char) (indices >> (8 * b));
+    }
+}
+
+void compressTextureLevel(uint32_t format, const unsigned char *rgba, uint32_t width, uint32_t height,
+                          std::vector<unsigned char> &blocks) {
+    blocks.resize(textureLevelSize(format, width, height));
+    unsigned char *block = blocks.data();
+    for (uint32_t by = 0; by < height; by += 4) {
+        for (uint32_t bx = 0; bx < width; bx += 4) {
+            unsigned char pixels[16][4];
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = std::min(bx + i % 4, width - 1), y = std::min(by + i / 4, height - 1);
+                memcpy(pixels[i], rgba + ((size_t) y * width + x) * 4, 4);
+            }
+            if (format == TEXTURE_FORMAT_BC3) {
+                compressAlphaBlock(pixels, block);
+                block += 8;
+            }
+            compressColorBlock(pixels, block);
+            block += 8;
+        }
+    }
+}
+
+static void decompressColorBlock(const unsigned char *block, bool alphaBlock, unsigned char pixels[16][4]) {
+    uint16_t color0, color1;
+    uint32_t indices;
+    memcpy(&color0, block, 2);
+    memcpy(&color1, block + 2, 2);
+    memcpy(&indices, block + 4, 4);
+    int palette[4][4];
+    unpackColor(color0, palette[0]);
+    unpackColor(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    // BC3 colour blocks always use four colours, BC1 switches to three plus transparent black when color0 <= color1
+    bool fourColors = alphaBlock || color0 > color1;
+    for (int c = 0; c < 3; c++) {
+        if (fourColors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    if (!fourColors) {
+        palette[3][3] = 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        const int *color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 4; c++) {
+            pixels[i][c] = (unsigned char) color[c];
+        }
+    }
+}
+
+static void decompressAlphaBlock(const unsigned char *block, unsigned char pixels[16][4]) {
+    int alpha0 = block[0], alpha1 = block[1];
+    int palette[8] = {alpha0, alpha1};
+    if (alpha0 > alpha1) {
+        for (int p = 1; p < 7; p++) {
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        }
+    } else {
+        for (int p = 1; p < 5; p++) {
+            palette[p + 1] = ((5 - p) * alpha0 + p * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int b = 0; b < 6; b++) {
+        indices |= (uint64_t) block[2 + b] << (8 * b);
+    }
+    for (int i = 0; i < 16; i++) {
+        pixels[i][3] = (unsigned char) palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+void decompressTextureLevel(uint32_t format, const unsigned char *blocks, uint32_t width, uint32_t height,
+                            unsigned char *rgba) {
+    const unsigned char *block = blocks;
+    for (uint32_t by = 0; by < height; by += 4) {
+        for (uint32_t bx = 0; bx < width; bx += 4) {
+            unsigned char pixels[16][4];
+            if (format == TEXTURE_FORMAT_BC3) {
+                decompressColorBlock(block + 8, true, pixels);
+                decompressAlphaBlock(block, pixels);
+                block += 16;
+            } else {
+                decompressColorBlock(block, false, pixels);
+                block += 8;
+            }
+            for (uint32_t i = 0; i < 16; i++) {
+                uint32_t x = bx + i % 4, y = by + i / 4;
+                if (x < width && y < height) {
+                    memcpy(rgba + ((size_t) y * width + x) * 4, pixels[i], 4);
+                }
+            }
+        }
+    }
+}
+
+// 2x2 box filter, odd edges repeat their last row or column
+std::vector<unsigned char> downsampleTextureLevel(const std::vector<unsigned char> &rgba, uint32_t width, uint32_t height) {
+    uint32_t halfWidth = std::max(1u, width / 2), halfHeight = std::max(1u, height / 2);
+    std::vector<unsigned char> result((size_t) halfWidth * halfHeight * 4);
+    for (uint32_t y = 0; y < halfHeight; y++) {
+        for (uint32_t x = 0; x < halfWidth; x++) {
+            uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int c = 0; c < 4; c++) {
+                int sum = rgba[((size_t) y0 * width + x0) * 4 + c] + rgba[((size_t) y0 * width + x1) * 4 + c]
+                          + rgba[((size_t) y1 * width + x0) * 4 + c] + rgba[((size_t) y1 * width + x1) * 4 + c];
+                result[((size_t) y * halfWidth + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+bool writeTextureFile(const std::string &path, uint32_t format, uint32_t width, uint32_t height, bool flipped,
+                      const std::vector<std::vector<unsigned char> > &levels) {
+    TextureFileHeader header = {};
+    memcpy(header.magic, "PTEX", 4);
+    header.version = TEXTURE_FILE_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.levelCount = levels.size();
+    header.flipped = flipped ? 1 : 0;
+
+    std::vector<TextureFileLevel> records(levels.size());
+    uint64_t offset = sizeof(TextureFileHeader) + records.size() * sizeof(TextureFileLevel);
+    for (unsigned int i = 0; i < levels.size(); i++) {
+        offset = alignTo(offset, 16);
+        records[i].offset = offset;
+        records[i].size = levels[i].size();
+        records[i].width = std::max(1u, width >> i);
+        records[i].height = std::max(1u, height >> i);
+        offset += levels[i].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::TEXTURE_FILE::COULD_NOT_WRITE " << path << std::endl;
+        return false;
+    }
+    const char padding[16] = {};
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) records.data(), records.size() * sizeof(TextureFileLevel));
+    uint64_t written = sizeof(TextureFileHeader) + records.size() * sizeof(TextureFileLevel);
+    for (unsigned int i = 0; i < levels.size(); i++) {
+        file.write(padding, records[i].offset - written);
+        file.write((const char *) levels[i].data(), levels[i].size());
+        written = records[i].offset + records[i].size;
+    }
+    return (bool) file;
+}
+
+bool readTextureFile(const std::string &path, TextureFile &file) {
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        return false;
+    }
+    file.data.resize((size_t) stream.tellg());
+    stream.seekg(0);
+    if (!stream.read((char *) file.data.data(), file.data.size()) || file.data.size() < sizeof(TextureFileHeader)) {
+        std::cout << "ERROR::TEXTURE_FILE::COULD_NOT_READ " << path << std::endl;
+        return false;
+    }
+    // validate before anyone follows the offsets
+    memcpy(&file.header, file.data.data(), sizeof(TextureFileHeader));
+    const TextureFileHeader &h = file.header;
+    bool valid = memcmp(h.magic, "PTEX", 4) == 0 && h.version == TEXTURE_FILE_VERSION
+                 && (h.format == TEXTURE_FORMAT_BC1 || h.format == TEXTURE_FORMAT_BC3)
+                 && h.levelCount > 0 && h.levelCount <= 32
+                 && sizeof(TextureFileHeader) + h.levelCount * sizeof(TextureFileLevel) <= file.data.size();
+    if (valid) {
+        file.levels.resize(h.levelCount);
+        memcpy(file.levels.data(), file.data.data() + sizeof(TextureFileHeader),
+               h.levelCount * sizeof(TextureFileLevel));
+    }
+    for (uint32_t i = 0; valid && i < h.levelCount; i++) {
+        const TextureFileLevel &level = file.levels[i];
+        valid = level.offset + level.size <= file.data.size()
+                && level.size == textureLevelSize(h.format, level.width, level.height);
+    }
+    if (!valid) {
+        std::cout << "ERROR::TEXTURE_FILE::INVALID_OR_OUTDATED " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Baked texture format, laid out like a minimal KTX2 file: a header, a level index and the block compressed data of
+ * every mip level, largest first, each level 16 byte aligned.
+ *
+ *   TextureFileHeader
+ *   TextureFileLevel[levelCount]
+ *   level data                     at TextureFileLevel::offset, rows of 4x4 blocks
+ *
+ * Files are written by tools/texbake and picked up by the texture streamer when they sit next to the source image.
+ */
+const char *const TEXTURE_FILE_EXTENSION = ".ptex";
+const uint32_t TEXTURE_FILE_VERSION = 1;
+
+enum TextureFileFormat : uint32_t {
+    TEXTURE_FORMAT_BC1 = 1, // RGB, 8 bytes per block
+    TEXTURE_FORMAT_BC3 = 2  // RGBA, 16 bytes per block
+};
+
+struct TextureFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t flipped; // rows were flipped on the y-axis while baking
+    uint32_t reserved;
+};
+
+struct TextureFileLevel {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct TextureFile {
+    TextureFileHeader header;
+    std::vector<TextureFileLevel> levels;
+    std::vector<unsigned char> data; // the whole file, levels point into it
+};
+
+size_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height);
+
+// compresses tightly packed RGBA8 pixels, edge blocks repeat the last row and column
+void compressTextureLevel(uint32_t format, const unsigned char *rgba, uint32_t width, uint32_t height,
+                          std::vector<unsigned char> &blocks);
+
+// expands a compressed level back to RGBA8, for drivers without S3TC support
+void decompressTextureLevel(uint32_t format, const unsigned char *blocks, uint32_t width, uint32_t height,
+                            unsigned char *rgba);
+
+// the next mip level of tightly packed RGBA8 pixels
+std::vector<unsigned char> downsampleTextureLevel(const std::vector<unsigned char> &rgba, uint32_t width,
+                                                  uint32_t height);
+
+// levels holds the compressed data of every mip level, largest first
+bool writeTextureFile(const std::string &path, uint32_t format, uint32_t width, uint32_t height, bool flipped,
+                      const std::vector<std::vector<unsigned char> > &levels);
+
+bool readTextureFile(const std::string &path, TextureFile &file);
+
+#endif //TEXTUREFILE_H
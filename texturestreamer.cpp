@@ -0,0 +1,437 @@
+#include "texturestreamer.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// glBufferStorage only exists when glad was generated for GL 4.4 or with ARB_buffer_storage.
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define TEXTURESTREAMER_HAS_BUFFER_STORAGE 1
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_SRGB8_ALPHA8
+#define GL_SRGB8_ALPHA8 0x8C43
+#endif
+
+static GLenum compressedFormat(uint32_t format, bool gamma) {
+    if (format == TEXTURE_FORMAT_BC1) {
+        return gamma ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+    return gamma ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+static bool endsWith(const std::string &value, const std::string &suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+TextureStreamer::TextureStreamer(unsigned int decodeThreads, size_t uploadBudget)
+        : running(true), uploadBudget(uploadBudget), segmentSize(0), pbo(0), mapped(nullptr), segment(0),
+          compressedSupport(-1) {
+    std::fill(fences, fences + UPLOAD_SEGMENTS, (GLsync) nullptr);
+    if (decodeThreads == 0) {
+        decodeThreads = std::max(1u, std::thread::hardware_concurrency() - 1);
+    }
+    for (unsigned int i = 0; i < decodeThreads; i++) {
+        workers.emplace_back(&TextureStreamer::decode, this);
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    // GL objects are left to the context, only the threads have to be stopped here
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+TextureStreamer &TextureStreamer::shared() {
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+StreamedTexture *TextureStreamer::load(const std::string &path, bool flip, bool gamma) {
+    if (placeholder.array == 0) {
+        // a single mid grey texel keeps materials readable while the real texture streams in
+        const unsigned char grey[] = {128, 128, 128, 255};
+        placeholder = layers.allocate(1, 1, GL_RGBA8, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, placeholder.layer, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (compressedSupport < 0) {
+        compressedSupport = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (name != nullptr && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+                compressedSupport = 1;
+            }
+        }
+    }
+    if (idle()) {
+        start = std::chrono::high_resolution_clock::now();
+    }
+    textures.emplace_back(new StreamedTexture());
+    StreamedTexture *texture = textures.back().get();
+    texture->array = placeholder.array;
+    texture->layer = placeholder.layer;
+    texture->path = path;
+    statistics.requested++;
+
+    Job *job = new Job();
+    job->texture = texture;
+    job->flip = flip;
+    job->gamma = gamma;
+    job->compressedSupported = compressedSupport == 1;
+    pending.push_back(job);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(job);
+    }
+    wake.notify_one();
+    return texture;
+}
+
+void TextureStreamer::decode() {
+    while (true) {
+        Job *job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return !running || !requests.empty(); });
+            if (!running) {
+                return;
+            }
+            job = requests.front();
+            requests.pop_front();
+        }
+        const std::string &path = job->texture->path;
+        std::unique_ptr<TextureFile> baked(new TextureFile());
+        if (readTextureFile(endsWith(path, TEXTURE_FILE_EXTENSION) ? path : path + TEXTURE_FILE_EXTENSION, *baked)
+            && baked->header.flipped == (job->flip ? 1u : 0u)) {
+            decodeBaked(job, std::move(baked));
+        } else {
+            decodeImage(job);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(job);
+    }
+}
+
+void TextureStreamer::decodeBaked(Job *job, std::unique_ptr<TextureFile> baked) {
+    if (job->compressedSupported) {
+        job->format = compressedFormat(baked->header.format, job->gamma);
+        job->blockBytes = baked->header.format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+        for (const TextureFileLevel &level : baked->levels) {
+            job->levels.push_back({baked->data.data() + level.offset, (int) level.width, (int) level.height,
+                                   (size_t) ((level.width + 3) / 4) * job->blockBytes, 4});
+        }
+        job->baked = std::move(baked);
+        return;
+    }
+    // uncompressed fallback, every level is expanded back to RGBA8
+    job->format = job->gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    for (const TextureFileLevel &level : baked->levels) {
+        job->pixels.emplace_back((size_t) level.width * level.height * 4);
+        decompressTextureLevel(baked->header.format, baked->data.data() + level.offset, level.width, level.height,
+                               job->pixels.back().data());
+        job->levels.push_back({job->pixels.back().data(), (int) level.width, (int) level.height,
+                               (size_t) level.width * 4, 1});
+    }
+}
+
+void TextureStreamer::decodeImage(Job *job) {
+    // flipping is done here rather than through stbi_set_flip_vertically_on_load, which is global state. Every image
+    // is expanded to RGBA8 so textures of the same size share an array whatever their channel count.
+    int width, height, components;
+    unsigned char *data = stbi_load(job->texture->path.c_str(), &width, &height, &components, 4);
+    if (data == nullptr) {
+        return;
+    }
+    size_t rowBytes = (size_t) width * 4;
+    job->pixels.emplace_back((size_t) height * rowBytes);
+    for (int row = 0; row < height; row++) {
+        int source = job->flip ? height - 1 - row : row;
+        memcpy(job->pixels.back().data() + row * rowBytes, data + source * rowBytes, rowBytes);
+    }
+    stbi_image_free(data);
+    // the mip chain is built here rather than by glGenerateMipmap, which would touch every layer of the array
+    uint32_t levelWidth = width, levelHeight = height;
+    while (levelWidth > 1 || levelHeight > 1) {
+        job->pixels.push_back(downsampleTextureLevel(job->pixels.back(), levelWidth, levelHeight));
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+    }
+    job->format = job->gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    for (size_t level = 0; level < job->pixels.size(); level++) {
+        int w = std::max(1, width >> level), h = std::max(1, height >> level);
+        job->levels.push_back({job->pixels[level].data(), w, h, (size_t) w * 4, 1});
+    }
+}
+
+void TextureStreamer::createBuffers() {
+    segmentSize = (uploadBudget + 255) & ~(size_t) 255;
+    size_t size = segmentSize * UPLOAD_SEGMENTS;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+#ifdef TEXTURESTREAMER_HAS_BUFFER_STORAGE
+    if (glBufferStorage != nullptr) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        mapped = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    }
+#endif
+    if (mapped == nullptr) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::deleteBuffers() {
+    for (GLsync &fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (pbo != 0) {
+        if (mapped != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &pbo);
+        pbo = 0;
+    }
+}
+
+void TextureStreamer::update() {
+    statistics.bytesLastFrame = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uploading.insert(uploading.end(), decoded.begin(), decoded.end());
+        decoded.clear();
+    }
+    if (uploading.empty()) {
+        return;
+    }
+    if (pbo == 0) {
+        createBuffers();
+    }
+    // the GPU may still be reading this segment from UPLOAD_SEGMENTS frames ago; rather skip a frame than stall
+    GLsync &fence = fences[segment];
+    if (fence != nullptr) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    size_t base = segment * segmentSize;
+    unsigned char *destination = mapped != nullptr ? mapped + base : (unsigned char *) glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER, base, segmentSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    std::vector<Upload> uploads;
+    size_t used = 0;
+    bool full = false;
+    for (auto next = uploading.begin(); next != uploading.end() && !full; ++next) {
+        Job *job = *next;
+        if (job->cancelled) {
+            continue;
+        }
+        while (!uploaded(job)) {
+            const Level &level = job->levels[job->nextLevel];
+            int levelRows = (level.height + level.rowHeight - 1) / level.rowHeight;
+            int rows = std::min<int>(levelRows - job->nextRow, (int) ((segmentSize - used) / level.rowBytes));
+            if (rows <= 0) {
+                // a row wider than a whole segment goes straight from client memory, on a frame of its own
+                if (level.rowBytes > segmentSize && uploads.empty()) {
+                    uploads.push_back({job, job->nextLevel, job->nextRow, 1,
+                                       level.data + job->nextRow * level.rowBytes, level.rowBytes, true});
+                    job->nextRow++;
+                }
+                full = true;
+                break;
+            }
+            size_t size = rows * level.rowBytes;
+            memcpy(destination + used, level.data + job->nextRow * level.rowBytes, size);
+            uploads.push_back({job, job->nextLevel, job->nextRow, rows, (const void *) (base + used), size, false});
+            used = (used + size + 3) & ~(size_t) 3;
+            job->nextRow += rows;
+            if (job->nextRow == levelRows) {
+                job->nextLevel++;
+                job->nextRow = 0;
+            }
+        }
+    }
+    if (mapped == nullptr) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (Upload &upload : uploads) {
+        if (upload.direct) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        this->upload(upload);
+        statistics.bytesLastFrame += upload.size;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE0);
+    if (used > 0) {
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        segment = (segment + 1) % UPLOAD_SEGMENTS;
+    }
+    statistics.bytesUploaded += statistics.bytesLastFrame;
+
+    auto done = std::remove_if(uploading.begin(), uploading.end(), [this](Job *job) {
+        if (!uploaded(job) && !job->cancelled) {
+            return false;
+        }
+        finishTexture(job);
+        return true;
+    });
+    uploading.erase(done, uploading.end());
+    if (idle()) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "Textures: " << statistics.completed << " streamed in " << elapsed.count() << " ms ("
+                  << statistics.bytesUploaded / 1024 << " KB uploaded, " << layers.arrayCount() << " arrays)"
+                  << std::endl;
+    }
+}
+
+// the layer is allocated on the first upload, once the decoded size and format are known
+void TextureStreamer::upload(const Upload &upload) {
+    Job *job = upload.job;
+    if (job->target.array == 0) {
+        job->target = layers.allocate(job->levels[0].width, job->levels[0].height, job->format, job->levels.size(),
+                                      job->blockBytes);
+    }
+    TextureArrays::bind(TextureArrays::UPLOAD_UNIT, job->target.array);
+    const Level &level = job->levels[upload.level];
+    int y = upload.row * level.rowHeight;
+    int height = std::min(upload.rows * level.rowHeight, level.height - y);
+    if (job->blockBytes > 0) {
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, upload.level, 0, y, job->target.layer, level.width, height, 1,
+                                  job->format, (GLsizei) upload.size, upload.source);
+    } else {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, upload.level, 0, y, job->target.layer, level.width, height, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, upload.source);
+    }
+}
+
+bool TextureStreamer::uploaded(const Job *job) {
+    return job->nextLevel == job->levels.size();
+}
+
+void TextureStreamer::finishTexture(Job *job) {
+    pending.erase(std::find(pending.begin(), pending.end(), job));
+    StreamedTexture *texture = job->texture;
+    if (job->cancelled) {
+        if (job->target.array != 0) {
+            layers.release(job->target);
+        }
+        unload(texture);
+    } else if (job->levels.empty()) {
+        std::cout << "Texture failed to load at path: " << texture->path << std::endl;
+        texture->failed = true;
+    } else {
+        for (const Level &level : job->levels) {
+            texture->bytes += level.rowBytes * ((level.height + level.rowHeight - 1) / level.rowHeight);
+        }
+        texture->array = job->target.array;
+        texture->layer = job->target.layer;
+        texture->width = job->levels[0].width;
+        texture->height = job->levels[0].height;
+        texture->ready = true;
+    }
+    statistics.completed++;
+    delete job;
+}
+
+void TextureStreamer::unload(StreamedTexture *texture) {
+    for (Job *job : pending) {
+        if (job->texture == texture) {
+            job->cancelled = true;
+            return;
+        }
+    }
+    if (texture->ready) {
+        TextureLayer layer;
+        layer.array = texture->array;
+        layer.layer = texture->layer;
+        layers.release(layer);
+    }
+    auto owner = std::find_if(textures.begin(), textures.end(), [texture](const std::unique_ptr<StreamedTexture> &t) {
+        return t.get() == texture;
+    });
+    if (owner != textures.end()) {
+        textures.erase(owner);
+    }
+}
+
+bool TextureStreamer::idle() const {
+    return statistics.completed == statistics.requested;
+}
+
+void TextureStreamer::setUploadBudget(size_t bytes) {
+    uploadBudget = bytes;
+    // the buffer is recreated at the new size on the next update; rows already uploaded stay uploaded
+    if (pbo != 0) {
+        deleteBuffers();
+    }
+}
+
+void TextureStreamer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        for (Job *job : requests) {
+            delete job;
+        }
+        requests.clear();
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    // only now, a worker that was still decoding has pushed its job by the time it is joined
+    uploading.insert(uploading.end(), decoded.begin(), decoded.end());
+    decoded.clear();
+    for (Job *job : uploading) {
+        delete job;
+    }
+    uploading.clear();
+    pending.clear();
+    deleteBuffers();
+    layers.destroy();
+}
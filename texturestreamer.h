@@ -0,0 +1,162 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <glad/glad.h>
+
+#include <texturearrays.h>
+#include <texturefile.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Handle to a texture that is still being loaded. array and layer name a shared placeholder until every level has
+// been uploaded and then switch to the texture's own layer, so read them at draw time instead of copying them once.
+struct StreamedTexture {
+    unsigned int array = 0; // GL_TEXTURE_2D_ARRAY
+    int layer = 0;
+    bool ready = false;
+    bool failed = false;
+    int width = 0, height = 0;
+    size_t bytes = 0; // GPU memory including mipmaps, once ready
+    std::string path;
+};
+
+/**
+ * Loads textures without stalling the frame. Files are decoded by a pool of worker threads, which also build the mip
+ * chain; update() then copies the decoded rows into a persistently mapped pixel unpack buffer and uploads them into a
+ * layer of a shared texture array (see TextureArrays), at most uploadBudget bytes per frame. The buffer is split in
+ * segments guarded by fences, so the CPU never writes rows the GPU is still reading. Drivers without buffer storage
+ * map each segment for the frame instead.
+ * A baked file (path + ".ptex", see tools/texbake) is preferred over the source image: its block compressed mip levels
+ * are uploaded as they are, or expanded on the decode thread when the driver lacks S3TC.
+ */
+class TextureStreamer {
+public:
+    struct Stats {
+        unsigned int requested = 0;
+        unsigned int completed = 0;
+        size_t bytesUploaded = 0;
+        size_t bytesLastFrame = 0;
+    };
+
+    static const size_t DEFAULT_UPLOAD_BUDGET = 4 << 20;
+    static const unsigned int UPLOAD_SEGMENTS = 3;
+
+    // decodeThreads 0 uses one thread less than there are cores
+    explicit TextureStreamer(unsigned int decodeThreads = 0, size_t uploadBudget = DEFAULT_UPLOAD_BUDGET);
+
+    ~TextureStreamer();
+
+    // the streamer used by the model loader
+    static TextureStreamer &shared();
+
+    // queues a file for decoding and returns its handle right away. gamma stores colour data as sRGB. Call on the GL
+    // thread.
+    StreamedTexture *load(const std::string &path, bool flip = false, bool gamma = false);
+
+    // frees the texture's layer and its handle; one still streaming is only dropped once its decode finishes
+    void unload(StreamedTexture *texture);
+
+    // uploads decoded rows within the budget. Call once per frame on the GL thread.
+    void update();
+
+    // true once every requested texture is ready or has failed
+    bool idle() const;
+
+    // bytes of pixel data uploaded per frame at most; rows wider than this are uploaded one at a time
+    void setUploadBudget(size_t bytes);
+
+    const Stats &stats() const { return statistics; }
+
+    const TextureArrays &arrays() const { return layers; }
+
+    // see TextureArrays::setLodBias, on the GL thread
+    void setLodBias(float bias) { layers.setLodBias(bias); }
+
+    // joins the decode threads and frees the upload buffer and the arrays. Call while the GL context is current.
+    void shutdown();
+
+private:
+    // one mip level, uploaded in rows of rowHeight texels: 1 for RGBA8, 4 for compressed blocks
+    struct Level {
+        const unsigned char *data;
+        int width, height;
+        size_t rowBytes;
+        int rowHeight;
+    };
+
+    struct Job {
+        StreamedTexture *texture;
+        bool flip;
+        bool gamma;
+        bool cancelled = false;
+        bool compressedSupported;
+        // filled by a decode thread; no levels means the file could not be loaded
+        std::vector<Level> levels;
+        std::vector<std::vector<unsigned char> > pixels; // RGBA8 levels of a source image
+        std::unique_ptr<TextureFile> baked; // compressed levels read from a baked file
+        GLenum format = 0;
+        int blockBytes = 0;
+        // upload progress, GL thread only
+        TextureLayer target;
+        size_t nextLevel = 0;
+        int nextRow = 0;
+    };
+
+    struct Upload {
+        Job *job;
+        size_t level;
+        int row, rows;
+        const void *source; // offset into the unpack buffer, or client memory when direct
+        size_t size;
+        bool direct;
+    };
+
+    std::vector<std::unique_ptr<StreamedTexture>> textures;
+    std::deque<Job *> requests; // waiting for a decode thread
+    std::deque<Job *> decoded; // waiting for the GL thread
+    std::vector<Job *> uploading; // GL thread only
+    std::vector<Job *> pending; // every job not finished yet, GL thread only
+    std::mutex mutex; // guards requests, decoded and running
+    std::condition_variable wake;
+    std::vector<std::thread> workers;
+    bool running;
+
+    TextureArrays layers;
+    TextureLayer placeholder;
+    size_t uploadBudget;
+    size_t segmentSize;
+    unsigned int pbo;
+    unsigned char *mapped; // whole buffer when persistently mapped, nullptr otherwise
+    GLsync fences[UPLOAD_SEGMENTS];
+    unsigned int segment;
+    int compressedSupport; // -1 until checked on the GL thread
+    std::chrono::high_resolution_clock::time_point start; // first request since the streamer was last idle
+    Stats statistics;
+
+    void createBuffers();
+
+    void deleteBuffers();
+
+    void decode();
+
+    void decodeBaked(Job *job, std::unique_ptr<TextureFile> baked);
+
+    void decodeImage(Job *job);
+
+    void upload(const Upload &upload);
+
+    static bool uploaded(const Job *job);
+
+    void finishTexture(Job *job);
+};
+
+
+#endif //TEXTURESTREAMER_H
@@ -0,0 +1,103 @@
+/**
+ * Bakes any model Assimp can read into the binary mesh cache format Model maps at runtime (see meshcache.h).
+ *
+ * usage: meshbake <model file> [output file] [--compact] [--overdraw] [--no-optimize]
+ * The output defaults to the model path with ".pmesh" appended, which Model picks up automatically.
+ * --compact stores quantised vertices (see vertexformat.h), Model then uploads them as they are.
+ * Triangles and vertices are reordered for the vertex cache and fetch locality (see meshoptimize.h); --overdraw also
+ * sorts triangle clusters to reduce overdraw, --no-optimize keeps Assimp's order.
+ */
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <meshcache.h>
+#include <meshdata.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char **argv) {
+    string input, output;
+    VertexFormat format = VERTEX_FULL;
+    unsigned int optimizations = OPTIMIZE_DEFAULT;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--compact") {
+            format = VERTEX_COMPACT;
+        } else if (argument == "--overdraw") {
+            optimizations |= OPTIMIZE_OVERDRAW;
+        } else if (argument == "--no-optimize") {
+            optimizations = OPTIMIZE_NONE;
+        } else if (input.empty()) {
+            input = argument;
+        } else {
+            output = argument;
+        }
+    }
+    if (input.empty()) {
+        std::cout << "usage: " << argv[0] << " <model file> [output file] [--compact] [--overdraw] [--no-optimize]" << std::endl;
+        return 1;
+    }
+    if (output.empty()) {
+        output = input + MESH_CACHE_EXTENSION;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // same post processing as Model::loadModel, so baked and imported models are identical
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(input, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return 1;
+    }
+
+    vector<const aiMesh *> sources;
+    collectMeshes(scene->mRootNode, scene, sources);
+    vector<MeshData> meshes(sources.size());
+    convertMeshes(sources, [&](unsigned int i, MeshData &data) { meshes[i] = std::move(data); }, format,
+                  optimizations);
+
+    vector<MeshCacheMaterialSource> materials(scene->mNumMaterials);
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++) {
+        for (unsigned int t = 0; t < MATERIAL_TEXTURE_TYPES; t++) {
+            for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(materialTextureTypes[t]); i++) {
+                aiString path;
+                scene->mMaterials[m]->GetTexture(materialTextureTypes[t], i, &path);
+                materials[m].textures.push_back(make_pair(t, string(path.C_Str())));
+            }
+        }
+    }
+
+    if (!writeMeshCache(output, input, meshes, materials)) {
+        return 1;
+    }
+    size_t vertices = 0, triangles = 0;
+    size_t lodTriangles[MAX_MESH_LODS] = {};
+    double missesBefore = 0.0, missesAfter = 0.0;
+    for (auto &mesh : meshes) {
+        vertices += mesh.vertexCount();
+        triangles += mesh.triangleCount();
+        // meshes without a level fall back to their coarsest one
+        for (unsigned int l = 0; l < MAX_MESH_LODS; l++) {
+            lodTriangles[l] += mesh.lods[std::min<size_t>(l, mesh.lods.size() - 1)].indexCount / 3;
+        }
+        missesBefore += mesh.acmrBefore * mesh.triangleCount();
+        missesAfter += mesh.acmrAfter * mesh.triangleCount();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << output << ": " << meshes.size() << " meshes, " << vertices << " "
+              << (format == VERTEX_COMPACT ? "compact" : "full") << " vertices ("
+              << vertices * (format == VERTEX_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex)) / 1024 << " KB), "
+              << triangles << " triangles, " << materials.size() << " materials (" << elapsed.count() << " ms)"
+              << std::endl;
+    if (triangles > 0) {
+        std::cout << "ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles << ", LOD triangles";
+        for (unsigned int l = 0; l < MAX_MESH_LODS; l++) {
+            std::cout << (l == 0 ? " " : " / ") << lodTriangles[l];
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * Compiles a text level description into the binary scene format (see scenefile.h).
+ *
+ * usage: scenebake <level> [output file] [--check]
+ * The output defaults to the level path with ".pscene" appended, which loadSceneFile picks up automatically. --check
+ * only parses and validates. Either way the tool reports how long the text and the binary take to load and how much
+ * memory the level holds, so format changes can be measured against both.
+ */
+#include <scenefile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    std::string input, output;
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--check") {
+            check = true;
+        } else if (input.empty()) {
+            input = argument;
+        } else {
+            output = argument;
+        }
+    }
+    if (input.empty()) {
+        std::cout << "usage: " << argv[0] << " <level> [output file] [--check]" << std::endl;
+        return 1;
+    }
+    if (output.empty()) {
+        output = input + SCENE_FILE_EXTENSION;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    SceneDescription scene;
+    if (!parseSceneText(input, scene)) {
+        return 1;
+    }
+    double parseTime = millisecondsSince(start);
+    if (!validateScene(scene, input)) {
+        return 1;
+    }
+    std::cout << input << ": " << scene.meshes.size() << " meshes, " << scene.vertexCount() << " vertices, "
+              << scene.materials.size() << " materials, " << scene.instances.size() << " instances, "
+              << scene.portals.size() << " portal pairs, " << scene.memory() / 1024.0 << " KB (text "
+              << parseTime << " ms)" << std::endl;
+    if (check) {
+        return 0;
+    }
+
+    if (!writeSceneFile(output, scene)) {
+        return 1;
+    }
+    // read it back the way the game will, and make sure nothing was lost on the way
+    start = std::chrono::high_resolution_clock::now();
+    SceneDescription loaded;
+    if (!readSceneFile(output, loaded)) {
+        return 1;
+    }
+    double readTime = millisecondsSince(start);
+    bool same = loaded.vertices == scene.vertices && loaded.meshes.size() == scene.meshes.size() &&
+                loaded.materials.size() == scene.materials.size() &&
+                loaded.instances.size() == scene.instances.size() && loaded.portals.size() == scene.portals.size() &&
+                memcmp(loaded.instances.data(), scene.instances.data(),
+                       scene.instances.size() * sizeof(SceneFileInstance)) == 0;
+    if (!same) {
+        std::cout << "ERROR::SCENE_FILE::ROUND_TRIP " << output << std::endl;
+        return 1;
+    }
+    std::cout << output << ": binary " << readTime << " ms, " << parseTime / std::max(readTime, 1e-6)
+              << "x faster than text" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Bakes an image into the block compressed texture format the streamer uploads directly (see texturefile.h).
+ *
+ * usage: texbake <image> [output file] [--flip] [--bc1 | --bc3]
+ * The output defaults to the image path with ".ptex" appended, which the texture streamer picks up automatically.
+ * Images with any transparent texel are stored as BC3, everything else as BC1. --flip stores the rows flipped on the
+ * y-axis and must match how the texture is requested at runtime, the scene's textures are loaded flipped.
+ */
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <texturefile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    std::string input, output;
+    bool flip = false;
+    uint32_t format = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--flip") {
+            flip = true;
+        } else if (argument == "--bc1") {
+            format = TEXTURE_FORMAT_BC1;
+        } else if (argument == "--bc3") {
+            format = TEXTURE_FORMAT_BC3;
+        } else if (input.empty()) {
+            input = argument;
+        } else {
+            output = argument;
+        }
+    }
+    if (input.empty()) {
+        std::cout << "usage: " << argv[0] << " <image> [output file] [--flip] [--bc1 | --bc3]" << std::endl;
+        return 1;
+    }
+    if (output.empty()) {
+        output = input + TEXTURE_FILE_EXTENSION;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int width, height, components;
+    stbi_set_flip_vertically_on_load(flip);
+    unsigned char *data = stbi_load(input.c_str(), &width, &height, &components, 4);
+    if (data == nullptr) {
+        std::cout << "Texture failed to load at path: " << input << std::endl;
+        return 1;
+    }
+    std::vector<unsigned char> level(data, data + (size_t) width * height * 4);
+    stbi_image_free(data);
+    if (format == 0) {
+        bool transparent = false;
+        for (size_t i = 3; i < level.size() && !transparent; i += 4) {
+            transparent = level[i] != 255;
+        }
+        format = transparent ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1;
+    }
+
+    // the full chain down to 1x1, so the runtime never calls glGenerateMipmap
+    std::vector<std::vector<unsigned char> > levels;
+    uint32_t levelWidth = width, levelHeight = height;
+    while (true) {
+        levels.emplace_back();
+        compressTextureLevel(format, level.data(), levelWidth, levelHeight, levels.back());
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        level = downsampleTextureLevel(level, levelWidth, levelHeight);
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+    }
+
+    if (!writeTextureFile(output, format, width, height, flip, levels)) {
+        return 1;
+    }
+    size_t bytes = 0;
+    for (auto &l : levels) {
+        bytes += l.size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::cout << output << ": " << width << "x" << height << " " << (format == TEXTURE_FORMAT_BC1 ? "BC1" : "BC3")
+              << ", " << levels.size() << " levels, " << bytes / 1024 << " KB (uncompressed with mipmaps "
+              << (size_t) width * height * components * 4 / 3 / 1024 << " KB, " << elapsed.count() << " ms)"
+              << std::endl;
+    return 0;
+}
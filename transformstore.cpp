@@ -0,0 +1,102 @@
+#include "transformstore.h"
+
+#include <jobsystem.h>
+
+unsigned int TransformStore::add(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale) {
+    unsigned int index = worlds.size();
+    positionX.push_back(position.x);
+    positionY.push_back(position.y);
+    positionZ.push_back(position.z);
+    rotationX.push_back(rotation.x);
+    rotationY.push_back(rotation.y);
+    rotationZ.push_back(rotation.z);
+    rotationW.push_back(rotation.w);
+    scaleX.push_back(scale.x);
+    scaleY.push_back(scale.y);
+    scaleZ.push_back(scale.z);
+    worlds.push_back(glm::mat4(1.0f));
+    dirtyFlags.push_back(0);
+    markDirty(index);
+    return index;
+}
+
+void TransformStore::setPosition(unsigned int index, const glm::vec3 &position) {
+    positionX[index] = position.x;
+    positionY[index] = position.y;
+    positionZ[index] = position.z;
+    markDirty(index);
+}
+
+void TransformStore::setRotation(unsigned int index, const glm::quat &rotation) {
+    rotationX[index] = rotation.x;
+    rotationY[index] = rotation.y;
+    rotationZ[index] = rotation.z;
+    rotationW[index] = rotation.w;
+    markDirty(index);
+}
+
+void TransformStore::setScale(unsigned int index, const glm::vec3 &scale) {
+    scaleX[index] = scale.x;
+    scaleY[index] = scale.y;
+    scaleZ[index] = scale.z;
+    markDirty(index);
+}
+
+void TransformStore::markDirty(unsigned int index) {
+    if (!dirtyFlags[index]) {
+        dirtyFlags[index] = 1;
+        dirty.push_back(index);
+    }
+}
+
+size_t TransformStore::update(std::vector<unsigned int> *updated) {
+    size_t count = dirty.size();
+    if (count == 0) {
+        return 0;
+    }
+    // once a good part of the store is dirty one straight pass over the arrays beats chasing indices, and the
+    // compiler can vectorise it. Large stores split that pass over the job system.
+    if (count * 4 > worlds.size()) {
+        JobSystem::shared().parallelFor(0, worlds.size(), COMPOSE_GRAIN,
+                                        [this](size_t first, size_t last) { compose(first, last); }, "composeTransforms");
+    } else {
+        for (unsigned int index : dirty) {
+            compose(index, index + 1);
+        }
+    }
+    for (unsigned int index : dirty) {
+        dirtyFlags[index] = 0;
+    }
+    if (updated != nullptr) {
+        updated->insert(updated->end(), dirty.begin(), dirty.end());
+    }
+    dirty.clear();
+    return count;
+}
+
+void TransformStore::compose(size_t first, size_t last) {
+    // translate * rotate * scale written out, the rotation from the unit quaternion
+    for (size_t i = first; i < last; i++) {
+        float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z, wx = w * x, wy = w * y, wz = w * z;
+        float sx = scaleX[i], sy = scaleY[i], sz = scaleZ[i];
+        glm::mat4 &m = worlds[i];
+        m[0][0] = (1.0f - 2.0f * (yy + zz)) * sx;
+        m[0][1] = 2.0f * (xy + wz) * sx;
+        m[0][2] = 2.0f * (xz - wy) * sx;
+        m[0][3] = 0.0f;
+        m[1][0] = 2.0f * (xy - wz) * sy;
+        m[1][1] = (1.0f - 2.0f * (xx + zz)) * sy;
+        m[1][2] = 2.0f * (yz + wx) * sy;
+        m[1][3] = 0.0f;
+        m[2][0] = 2.0f * (xz + wy) * sz;
+        m[2][1] = 2.0f * (yz - wx) * sz;
+        m[2][2] = (1.0f - 2.0f * (xx + yy)) * sz;
+        m[2][3] = 0.0f;
+        m[3][0] = positionX[i];
+        m[3][1] = positionY[i];
+        m[3][2] = positionZ[i];
+        m[3][3] = 1.0f;
+    }
+}
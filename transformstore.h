@@ -0,0 +1,58 @@
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// matrices composed per job when update() rebuilds the whole store
+const size_t COMPOSE_GRAIN = 4096;
+
+/**
+ * Positions, rotations and scales of scene objects as structure of arrays, next to the world matrices built from them
+ * in one contiguous array that can go into an instance buffer as it is. Setters only mark an entry dirty and update()
+ * rebuilds the dirty matrices in one batch, so a scene where nothing moves does no transform work at all.
+ */
+class TransformStore {
+public:
+    unsigned int add(const glm::vec3 &position, const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                     const glm::vec3 &scale = glm::vec3(1.0f));
+
+    void setPosition(unsigned int index, const glm::vec3 &position);
+
+    void setRotation(unsigned int index, const glm::quat &rotation);
+
+    void setScale(unsigned int index, const glm::vec3 &scale);
+
+    glm::vec3 position(unsigned int index) const {
+        return glm::vec3(positionX[index], positionY[index], positionZ[index]);
+    }
+
+    // rebuilds the world matrix of every dirty entry and appends their indices to updated when given. Returns how
+    // many were rebuilt.
+    size_t update(std::vector<unsigned int> *updated = nullptr);
+
+    // as of the last update()
+    const glm::mat4 &world(unsigned int index) const { return worlds[index]; }
+
+    const glm::mat4 *worldMatrices() const { return worlds.data(); }
+
+    size_t size() const { return worlds.size(); }
+
+private:
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> dirtyFlags;
+    std::vector<unsigned int> dirty;
+
+    void markDirty(unsigned int index);
+
+    // world matrices of entries first..last-1
+    void compose(size_t first, size_t last);
+};
+
+#endif //TRANSFORMSTORE_H
@@ -0,0 +1,88 @@
+#include "vertexformat.h"
+
+#include <cmath>
+#include <cstring>
+
+VertexQuantisation vertexQuantisation(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    VertexQuantisation quantisation;
+    quantisation.offset = (boundsMin + boundsMax) * 0.5f;
+    quantisation.scale = (boundsMax - boundsMin) * 0.5f;
+    // a flat axis has nothing to quantise, any scale decodes it to the offset
+    for (int axis = 0; axis < 3; axis++) {
+        if (quantisation.scale[axis] <= 0.0f) {
+            quantisation.scale[axis] = 1.0f;
+        }
+    }
+    return quantisation;
+}
+
+static int16_t snorm16(float value) {
+    return (int16_t) std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// projects the unit vector onto an octahedron and folds the lower half over the upper one
+static glm::vec2 octahedral(const glm::vec3 &v) {
+    float length = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+    if (length == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 p = glm::vec2(v.x, v.y) / length;
+    if (v.z < 0.0f) {
+        p = glm::vec2((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return p;
+}
+
+CompactVertex compactVertex(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec2 &texCoords,
+                            const glm::vec3 &tangent, const glm::vec3 &bitangent,
+                            const VertexQuantisation &quantisation) {
+    CompactVertex vertex;
+    glm::vec3 local = (position - quantisation.offset) / quantisation.scale;
+    for (int axis = 0; axis < 3; axis++) {
+        vertex.position[axis] = snorm16(local[axis]);
+    }
+    vertex.position[3] = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -32767 : 32767;
+    glm::vec2 n = octahedral(normal), t = octahedral(tangent);
+    vertex.normal[0] = snorm16(n.x);
+    vertex.normal[1] = snorm16(n.y);
+    vertex.tangent[0] = snorm16(t.x);
+    vertex.tangent[1] = snorm16(t.y);
+    vertex.texCoords[0] = packHalf(texCoords.x);
+    vertex.texCoords[1] = packHalf(texCoords.y);
+    return vertex;
+}
+
+uint16_t packHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (biased == 0xff) {
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0); // infinity or NaN
+    }
+    int exponent = (int) biased - 127 + 15;
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        // subnormal half, or zero when even that is too small
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = sign | ((uint32_t) exponent << 10) | (mantissa >> 13);
+    // a carry out of the mantissa rounds up into the exponent, which is still the nearest half
+    if (mantissa & 0x1000) {
+        half++;
+    }
+    return half;
+}
@@ -0,0 +1,38 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// vertex layout a mesh is uploaded with. Chosen when a model is loaded or baked, shaders decode COMPACT_VERTEX.
+enum VertexFormat : uint32_t {
+    VERTEX_FULL = 0,   // mesh.h's Vertex, 56 bytes of floats
+    VERTEX_COMPACT = 1 // CompactVertex, 20 bytes
+};
+
+// A quantised vertex. Positions are snorm16 relative to the mesh bounds, normal and tangent are octahedral encoded and
+// the bitangent is rebuilt as cross(normal, tangent) * position[3].
+struct CompactVertex {
+    int16_t position[4]; // snorm16, decoded with VertexQuantisation; w holds the bitangent sign
+    int16_t normal[2];   // octahedral, snorm16
+    int16_t tangent[2];  // octahedral, snorm16
+    uint16_t texCoords[2]; // half floats
+};
+
+// maps snorm16 positions back into the mesh bounds: position = offset + scale * snorm
+struct VertexQuantisation {
+    glm::vec3 offset;
+    glm::vec3 scale;
+};
+
+VertexQuantisation vertexQuantisation(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+CompactVertex compactVertex(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec2 &texCoords,
+                            const glm::vec3 &tangent, const glm::vec3 &bitangent,
+                            const VertexQuantisation &quantisation);
+
+// IEEE half float, rounded to nearest
+uint16_t packHalf(float value);
+
+#endif //VERTEXFORMAT_H